@@ -1,3 +1,11 @@
+/**
+ * The process wide pool of exported async watchers, see
+ * async_export().  Every lua_State (and thread) that loads this module
+ * shares it, so all access goes through async_pool_lock.
+ */
+static pthread_mutex_t  async_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static evlua_async_slot async_pool[ASYNC_POOL_SIZE];
+
 /**
  * Create a table for ev.Async that gives access to the constructor for
  * async objects.
@@ -7,11 +15,16 @@
 static int luaopen_ev_async(lua_State *L) {
     lua_pop(L, create_async_mt(L));
 
-    lua_createtable(L, 0, 1);
+    lua_pop(L, create_async_sender_mt(L));
+
+    lua_createtable(L, 0, 2);
 
     lua_pushcfunction(L, async_new);
     lua_setfield(L, -2, "new");
 
+    lua_pushcfunction(L, async_import);
+    lua_setfield(L, -2, "import");
+
     return 1;
 }
 
@@ -26,6 +39,8 @@ static int create_async_mt(lua_State *L) {
         { "send",          async_send },
         { "stop",          async_stop },
         { "start",         async_start },
+        { "export",        async_export },
+        { "__gc",          async_gc },
         { NULL, NULL }
     };
     luaL_newmetatable(L, ASYNC_MT);
@@ -35,6 +50,26 @@ static int create_async_mt(lua_State *L) {
     return 1;
 }
 
+/**
+ * Create the metatable for the senders returned by ev.Async.import().
+ *
+ * [-0, +1, ?]
+ */
+static int create_async_sender_mt(lua_State *L) {
+
+    static luaL_Reg fns[] = {
+        { "send",          async_sender_send },
+        { "__gc",          async_sender_gc },
+        { NULL, NULL }
+    };
+    luaL_newmetatable(L, ASYNC_SENDER_MT);
+    luaL_setfuncs(L, fns, 0);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+
+    return 1;
+}
+
 /**
  * Create a new async object.  Arguments:
  *   1 - callback function.
@@ -44,10 +79,11 @@ static int create_async_mt(lua_State *L) {
  * [+1, -0, ?]
  */
 static int async_new(lua_State* L) {
-    ev_async*  async;
+    evlua_async*  async;
 
-    async = watcher_new(L, sizeof(ev_async), ASYNC_MT);
-    ev_async_init(async, &async_cb );
+    async = watcher_new(L, sizeof(evlua_async), ASYNC_MT, OBJ_ASYNC);
+    ev_async_init(&async->async, &async_cb );
+    async->slot = 0;
     return 1;
 }
 
@@ -90,8 +126,10 @@ static int async_stop(lua_State *L) {
     ev_async*       async  = check_async(L, 1);
     struct ev_loop* loop   = *check_loop_and_init(L, 2);
 
-    loop_stop_watcher(L, 2, 1);
+    async_pool_set_loop(async, NULL);
+    loop_stop_watcher(L, 1);
     ev_async_stop(loop, async);
+    co_cancel(L, 1);
 
     return 0;
 }
@@ -111,6 +149,184 @@ static int async_start(lua_State *L) {
 
     ev_async_start(loop, async);
     loop_start_watcher(L, 2, 1, is_daemon);
+    async_pool_set_loop(async, loop);
+
+    return 0;
+}
+
+/**
+ * Tells the senders of an exported async which loop it is started in
+ * (NULL if it is stopped).
+ *
+ * [-0, +0, -]
+ */
+static void async_pool_set_loop(ev_async* async, struct ev_loop* loop) {
+    unsigned int slot = ((evlua_async*)async)->slot;
+
+    if ( 0 == slot ) return;
+
+    pthread_mutex_lock(&async_pool_lock);
+    async_pool[slot - 1].loop = loop;
+    pthread_mutex_unlock(&async_pool_lock);
+}
+
+/**
+ * Called by loop_delete() so no sender can reach a destroyed loop,
+ * whatever order the lua objects are collected in.
+ *
+ * [-0, +0, -]
+ */
+static void async_pool_forget_loop(struct ev_loop* loop) {
+    int i;
+
+    pthread_mutex_lock(&async_pool_lock);
+    for ( i = 0; i < ASYNC_POOL_SIZE; i++ ) {
+        if ( async_pool[i].loop == loop ) async_pool[i].loop = NULL;
+    }
+    pthread_mutex_unlock(&async_pool_lock);
+}
+
+/**
+ * Returns a token (an integer) that ev.Async.import() turns into a
+ * sender for this async in any lua_State of the process, including
+ * ones running in other threads.  Exporting the same async again
+ * returns the same token.
+ *
+ * Usage:
+ *     token = async:export()
+ *
+ * [+1, -0, e]
+ */
+static int async_export(lua_State *L) {
+    evlua_async*   async = (evlua_async*)check_async(L, 1);
+    evlua_watcher* ext   = WATCHER_EXT(async);
+    unsigned int   i;
+
+    pthread_mutex_lock(&async_pool_lock);
+    if ( 0 == async->slot ) {
+        for ( i = 0; i < ASYNC_POOL_SIZE && async_pool[i].refs; i++ );
+        if ( i == ASYNC_POOL_SIZE ) {
+            pthread_mutex_unlock(&async_pool_lock);
+            return luaL_error(L, "too many exported async watchers (max %d)",
+                              ASYNC_POOL_SIZE);
+        }
+        async_pool[i].gen++;
+        async_pool[i].refs  = 1;
+        async_pool[i].async = &async->async;
+        async_pool[i].loop  = ( ev_is_active(&async->async) && NULL != ext->loop ) ?
+            ext->loop->loop : NULL;
+        async->slot = i + 1;
+    }
+    i = async->slot - 1;
+    lua_pushinteger(L, (lua_Integer)async_pool[i].gen * ASYNC_POOL_SIZE + i);
+    pthread_mutex_unlock(&async_pool_lock);
+
+    return 1;
+}
+
+/**
+ * Detaches a collected async from its senders.
+ *
+ * [+0, -0, -]
+ */
+static int async_gc(lua_State *L) {
+    evlua_async* async = (evlua_async*)check_async(L, 1);
+
+    if ( 0 == async->slot ) return 0;
+
+    pthread_mutex_lock(&async_pool_lock);
+    async_pool[async->slot - 1].async = NULL;
+    async_pool[async->slot - 1].loop  = NULL;
+    async_pool[async->slot - 1].refs--;
+    pthread_mutex_unlock(&async_pool_lock);
+
+    async->slot = 0;
+    return 0;
+}
+
+/**
+ * Create a sender from a token returned by async:export().  The
+ * sender holds a reference on the pool entry, so it stays safe to use
+ * after the async (or the lua_State owning it) is gone; sending then
+ * simply does nothing.
+ *
+ * Usage:
+ *     sender = ev.Async.import(token)
+ *
+ * [-0, +1, e]
+ */
+static int async_import(lua_State *L) {
+    lua_Number          token = luaL_checknumber(L, 1);
+    evlua_async_sender* sender;
+    lua_Number          gen;
+    unsigned int        i;
+    int                 valid;
+
+    /* Converting NaN, inf or a huge number to unsigned is undefined: */
+    luaL_argcheck(L, token >= 0 && token == floor(token) &&
+                  token < ((lua_Number)UINT_MAX + 1) * ASYNC_POOL_SIZE,
+                  1, "invalid or expired async token");
+    gen = floor(token / ASYNC_POOL_SIZE);
+    i   = (unsigned int)(token - gen * ASYNC_POOL_SIZE);
+
+    sender = (evlua_async_sender*)
+        obj_new(L, sizeof(evlua_async_sender), ASYNC_SENDER_MT, OBJ_ASYNC_SENDER);
+    sender->slot = 0;
+
+    pthread_mutex_lock(&async_pool_lock);
+    valid = i < ASYNC_POOL_SIZE &&
+        async_pool[i].gen == gen && async_pool[i].async != NULL;
+    if ( valid ) {
+        async_pool[i].refs++;
+        sender->slot = i + 1;
+        sender->gen  = async_pool[i].gen;
+    }
+    pthread_mutex_unlock(&async_pool_lock);
+
+    if ( ! valid ) return luaL_argerror(L, 1, "invalid or expired async token");
+    return 1;
+}
+
+/**
+ * Wakes up the exported async, like async:send(loop) in the lua_State
+ * that owns it.  Returns false if the async is stopped or gone.
+ *
+ * Usage:
+ *     bool = sender:send()
+ *
+ * [+1, -0, e]
+ */
+static int async_sender_send(lua_State *L) {
+    evlua_async_sender* sender = check_async_sender(L, 1);
+    evlua_async_slot*   slot;
+    int                 sent   = 0;
+
+    pthread_mutex_lock(&async_pool_lock);
+    slot = &async_pool[sender->slot - 1];
+    if ( NULL != slot->async && NULL != slot->loop ) {
+        ev_async_send(slot->loop, slot->async);
+        sent = 1;
+    }
+    pthread_mutex_unlock(&async_pool_lock);
+
+    lua_pushboolean(L, sent);
+    return 1;
+}
+
+/**
+ * Drops the reference of a collected sender on its pool entry.
+ *
+ * [+0, -0, -]
+ */
+static int async_sender_gc(lua_State *L) {
+    evlua_async_sender* sender = check_async_sender(L, 1);
+
+    if ( 0 == sender->slot ) return 0;
+
+    pthread_mutex_lock(&async_pool_lock);
+    async_pool[sender->slot - 1].refs--;
+    pthread_mutex_unlock(&async_pool_lock);
 
+    sender->slot = 0;
     return 0;
 }
@@ -0,0 +1,95 @@
+-- Helpers shared by the bench/bench_*.lua micro-benchmarks.
+--
+-- Every measurement is printed as a single line of JSON so the output
+-- of `make bench` can be diffed or fed to other tools, for example:
+--
+--   {"bench":"timer_fire","ops":100000,"secs":0.0412,"ops_per_sec":2427184,"ns_per_op":412.0}
+--
+-- The number of operations is multiplied by the LUA_EV_BENCH_SCALE
+-- environment variable (default 1) so quick smoke runs and long
+-- stable runs use the same scripts.
+
+local ev    = require("ev")
+
+local bench = {}
+
+local clock = ev.Loop.new()
+
+bench.scale = tonumber(os.getenv("LUA_EV_BENCH_SCALE")) or 1
+
+-- Scale the requested number of operations.
+function bench.n(count)
+   return math.max(1, math.floor(count * bench.scale))
+end
+
+-- Wall clock seconds.
+function bench.now()
+   return clock:update_now()
+end
+
+-- Lua heap size in bytes after a full collection.
+function bench.heap()
+   collectgarbage("collect")
+   collectgarbage("collect")
+   return collectgarbage("count") * 1024
+end
+
+local function encode(value)
+   if type(value) == "string" then
+      return string.format("%q", value)
+   elseif value ~= value or value == math.huge or value == -math.huge then
+      return "null"
+   elseif math.floor(value) == value and math.abs(value) < 2^53 then
+      return string.format("%d", value)
+   end
+   return string.format("%.4f", value)
+end
+
+-- Print one result line.  Fields are emitted in the order given by
+-- keys so the output is stable.
+function bench.report(name, result, keys)
+   local out = { '"bench":' .. encode(name) }
+   for _, key in ipairs(keys) do
+      if result[key] ~= nil then
+         out[#out + 1] = string.format("%q:%s", key, encode(result[key]))
+      end
+   end
+   print("{" .. table.concat(out, ",") .. "}")
+   io.stdout:flush()
+end
+
+-- Run fn(ops) once and report throughput.  fn must perform exactly
+-- ops operations (callbacks, method calls, ...) and may return the
+-- number actually performed if that differs.
+function bench.run(name, ops, fn)
+   collectgarbage("collect")
+   local start = bench.now()
+   local done  = fn(ops) or ops
+   local secs  = bench.now() - start
+   bench.report(name, {
+      ops         = done,
+      secs        = secs,
+      ops_per_sec = secs > 0 and done / secs or 0/0,
+      ns_per_op   = done > 0 and secs * 1e9 / done or 0/0,
+   }, { "ops", "secs", "ops_per_sec", "ns_per_op" })
+end
+
+-- Create count objects with ctor(i) while keeping them reachable and
+-- report the Lua heap growth per object.
+function bench.memory(name, count, ctor)
+   local keep   = {}
+   -- Size the holding table up front so it is not counted:
+   for i = 1, count do keep[i] = false end
+   local before = bench.heap()
+   for i = 1, count do
+      keep[i] = ctor(i)
+   end
+   local after  = bench.heap()
+   bench.report(name, {
+      objects          = count,
+      bytes_per_object = (after - before) / count,
+   }, { "objects", "bytes_per_object" })
+   return keep
+end
+
+return bench
@@ -0,0 +1,35 @@
+local src_dir, build_dir = ...
+package.path  = src_dir .. "?.lua;" .. package.path
+package.cpath = build_dir .. "?.so;" .. package.cpath
+
+local ev    = require("ev")
+local bench = require("bench")
+
+local loop = ev.Loop.default
+
+-- Cost of async:send() itself (sends coalesce into one callback):
+bench.run("async_send", bench.n(1000000), function(n)
+   local async = ev.Async.new(function(loop, async) async:stop(loop) end)
+   async:start(loop)
+   for i = 1, n do
+      async:send(loop)
+   end
+   loop:loop()
+end)
+
+-- Send, wake up and dispatch, one callback per send:
+bench.run("async_roundtrip", bench.n(200000), function(n)
+   local count = 0
+   local async = ev.Async.new(function(loop, async)
+      count = count + 1
+      if count >= n then
+         async:stop(loop)
+      else
+         async:send(loop)
+      end
+   end)
+   async:start(loop)
+   async:send(loop)
+   loop:loop()
+   return count
+end)
@@ -0,0 +1,91 @@
+local src_dir, build_dir = ...
+package.path  = src_dir .. "?.lua;" .. package.path
+package.cpath = build_dir .. "?.so;" .. package.cpath
+
+local ev    = require("ev")
+local bench = require("bench")
+
+-- Compares the backends supported by the linked libev on the same
+-- workload: LUA_EV_BENCH_FDS (default 10000) socketpairs with a read
+-- watcher on one end each, and a few of them made readable per loop
+-- iteration.  That is what a busy server with many mostly idle
+-- connections looks like, and where the backends differ most.
+
+local has_posix, socket = pcall(require, "posix.sys.socket")
+if not has_posix then
+   io.stderr:write("bench_ev_backend: skipped, needs luaposix\n")
+   os.exit(0)
+end
+local unistd = require("posix.unistd")
+
+local want   = tonumber(os.getenv("LUA_EV_BENCH_FDS")) or 10000
+local active = 64
+
+local pairs_r, pairs_w = {}, {}
+for i = 1, want do
+   local r, w = socket.socketpair(socket.AF_UNIX, socket.SOCK_STREAM, 0)
+   if not r then
+      io.stderr:write("bench_ev_backend: only " .. (i - 1) ..
+                      " socketpairs, raise the fd limit (ulimit -n)\n")
+      break
+   end
+   pairs_r[i], pairs_w[i] = r, w
+end
+local fds = #pairs_r
+
+local backends = {
+   "BACKEND_SELECT", "BACKEND_POLL", "BACKEND_EPOLL", "BACKEND_KQUEUE",
+   "BACKEND_PORT", "BACKEND_LINUXAIO", "BACKEND_IOURING",
+}
+
+local supported = ev.supported_backends()
+for _, const in ipairs(backends) do
+   local backend = ev[const]
+   -- Bit test without relying on the bit operators of lua 5.3:
+   if backend and math.floor(supported / backend) % 2 == 1 then
+      local loop = ev.Loop.new(backend + ev.FLAG_NOENV)
+      local _, name = loop:backend()
+      local pending = 0
+      local ios = {}
+
+      local function on_read(loop, io)
+         unistd.read(io:getfd(), 1)
+         pending = pending - 1
+      end
+
+      bench.run("backend_" .. name .. "_start_" .. fds, fds, function(n)
+         for i = 1, n do
+            ios[i] = ev.IO.new(on_read, pairs_r[i], ev.READ)
+            ios[i]:start(loop)
+         end
+      end)
+
+      -- Wake up `active` random fds, then run the loop until all of
+      -- them were read.  Each callback is one operation:
+      local seed = 1
+      bench.run("backend_" .. name .. "_events_" .. fds, bench.n(100000), function(n)
+         local done = 0
+         while done < n do
+            for _ = 1, active do
+               seed = (seed * 1103515245 + 12345) % 2147483648
+               unistd.write(pairs_w[seed % fds + 1], "x")
+               pending = pending + 1
+            end
+            while pending > 0 do
+               loop:run{ once = true }
+            end
+            done = done + active
+         end
+         return done
+      end)
+
+      for i = 1, fds do
+         ios[i]:stop(loop)
+      end
+   end
+end
+
+for i = 1, fds do
+   unistd.close(pairs_r[i])
+   unistd.close(pairs_w[i])
+end
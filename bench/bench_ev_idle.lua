@@ -0,0 +1,24 @@
+local src_dir, build_dir = ...
+package.path  = src_dir .. "?.lua;" .. package.path
+package.cpath = build_dir .. "?.so;" .. package.cpath
+
+local ev    = require("ev")
+local bench = require("bench")
+
+local loop = ev.Loop.default
+
+-- How many idle callbacks the loop can spin per second:
+bench.run("idle_spin", bench.n(500000), function(n)
+   local count = 0
+   local idle  = ev.Idle.new(function(loop, idle)
+      count = count + 1
+      if count >= n then idle:stop(loop) end
+   end)
+   idle:start(loop)
+   loop:loop()
+   return count
+end)
+
+bench.memory("idle_memory", bench.n(100000), function()
+   return ev.Idle.new(function() end)
+end)
@@ -0,0 +1,93 @@
+local src_dir, build_dir = ...
+package.path  = src_dir .. "?.lua;" .. package.path
+package.cpath = build_dir .. "?.so;" .. package.cpath
+
+local ev    = require("ev")
+local bench = require("bench")
+
+local loop = ev.Loop.default
+
+-- A connected pair of non-blocking stream endpoints.  Each endpoint
+-- has fd, send(str) and recv().  Prefers a real socketpair(2) from
+-- luaposix, falls back to a loopback TCP connection from luasocket.
+local function stream_pair()
+   local has_posix, socket = pcall(require, "posix.sys.socket")
+   if has_posix then
+      local unistd = require("posix.unistd")
+      local fcntl  = require("posix.fcntl")
+      local a, b   = assert(socket.socketpair(socket.AF_UNIX, socket.SOCK_STREAM, 0))
+      local function wrap(fd)
+         local flags = fcntl.fcntl(fd, fcntl.F_GETFL)
+         if flags % (2 * fcntl.O_NONBLOCK) < fcntl.O_NONBLOCK then
+            fcntl.fcntl(fd, fcntl.F_SETFL, flags + fcntl.O_NONBLOCK)
+         end
+         return {
+            fd    = fd,
+            send  = function(str) return unistd.write(fd, str) end,
+            recv  = function() return unistd.read(fd, 4096) end,
+            close = function() unistd.close(fd) end,
+         }
+      end
+      return wrap(a), wrap(b)
+   end
+
+   local has_socket, socket = pcall(require, "socket")
+   if not has_socket then return nil end
+
+   local server = assert(socket.bind("127.0.0.1", 0))
+   local a      = assert(socket.connect(server:getsockname()))
+   local b      = assert(server:accept())
+   server:close()
+   local function wrap(sock)
+      sock:settimeout(0)
+      sock:setoption("tcp-nodelay", true)
+      return {
+         fd    = sock:getfd(),
+         send  = function(str) return sock:send(str) end,
+         recv  = function()
+            local data, err, partial = sock:receive(4096)
+            return data or partial
+         end,
+         close = function() sock:close() end,
+      }
+   end
+   return wrap(a), wrap(b)
+end
+
+local a, b = stream_pair()
+if not a then
+   io.stderr:write("bench_ev_io: skipped, needs luaposix or luasocket\n")
+   os.exit(0)
+end
+
+-- One byte bounces between both ends, each hop is one io callback:
+bench.run("io_pingpong", bench.n(100000), function(n)
+   local count = 0
+   local function bounce(me)
+      return function(loop, io)
+         me.recv()
+         count = count + 1
+         if count >= n then
+            loop:unloop()
+         else
+            me.send("x")
+         end
+      end
+   end
+   local io_a = ev.IO.new(bounce(a), a.fd, ev.READ)
+   local io_b = ev.IO.new(bounce(b), b.fd, ev.READ)
+   io_a:start(loop)
+   io_b:start(loop)
+   a.send("x")
+   loop:loop()
+   io_a:stop(loop)
+   io_b:stop(loop)
+   return count
+end)
+
+a.close()
+b.close()
+
+bench.memory("io_memory", bench.n(100000), function()
+   return ev.IO.new(function() end, 0, ev.READ)
+end)
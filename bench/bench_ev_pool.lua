@@ -0,0 +1,59 @@
+local src_dir, build_dir = ...
+package.path  = src_dir .. "?.lua;" .. package.path
+package.cpath = build_dir .. "?.so;" .. package.cpath
+
+local ev    = require("ev")
+local bench = require("bench")
+
+-- A request handler that arms a timeout and a read watcher, and drops
+-- both when the request completes, with and without pools.
+-- garbage_per_op is the lua heap growth per request with the garbage
+-- collector stopped, and gc_kb_per_sec what the collector has to get
+-- through at 100k requests/sec.
+
+local loop  = ev.Loop.new()
+local noop  = function() end
+local rate  = 100000
+
+local function garbage(name, n, fn)
+   bench.run(name, n, fn)
+
+   collectgarbage("collect")
+   collectgarbage("stop")
+   local before = collectgarbage("count")
+   fn(n)
+   local per_op = (collectgarbage("count") - before) * 1024 / n
+   collectgarbage("restart")
+
+   bench.report(name .. "_garbage", {
+      ops            = n,
+      garbage_per_op = per_op,
+      gc_kb_per_sec  = per_op * rate / 1024,
+   }, { "ops", "garbage_per_op", "gc_kb_per_sec" })
+end
+
+garbage("pool_none", bench.n(rate), function(n)
+   for i = 1, n do
+      local timer = ev.Timer.new(noop, 60)
+      local io    = ev.IO.new(noop, 0, ev.READ)
+      timer:start(loop)
+      io:start(loop)
+      io:stop(loop)
+      timer:stop(loop)
+   end
+end)
+
+local timers = ev.Timer.pool()
+local ios    = ev.IO.pool()
+garbage("pool_acquire_release", bench.n(rate), function(n)
+   for i = 1, n do
+      local timer = timers:acquire(noop, 60)
+      local io    = ios:acquire(noop, 0, ev.READ)
+      timer:start(loop)
+      io:start(loop)
+      io:stop(loop)
+      timer:stop(loop)
+      ios:release(io)
+      timers:release(timer)
+   end
+end)
@@ -0,0 +1,109 @@
+local src_dir, build_dir = ...
+package.path  = src_dir .. "?.lua;" .. package.path
+package.cpath = build_dir .. "?.so;" .. package.cpath
+
+local ev    = require("ev")
+local bench = require("bench")
+
+local loop = ev.Loop.default
+local noop = function() end
+
+-- Create, start and stop a fresh timer per operation:
+bench.run("timer_churn", bench.n(100000), function(n)
+   for i = 1, n do
+      local timer = ev.Timer.new(noop, 60)
+      timer:start(loop)
+      timer:stop(loop)
+   end
+end)
+
+-- Start and stop the same timer:
+local timer = ev.Timer.new(noop, 60)
+bench.run("timer_start_stop", bench.n(500000), function(n)
+   for i = 1, n do
+      timer:start(loop)
+      timer:stop(loop)
+   end
+end)
+
+-- Re-arm an active timer as an idle timeout would:
+bench.run("timer_again", bench.n(500000), function(n)
+   timer:start(loop)
+   for i = 1, n do
+      timer:again(loop, 60)
+   end
+   timer:stop(loop)
+end)
+
+-- Many timers expiring in a single loop iteration:
+bench.run("timer_fire", bench.n(100000), function(n)
+   local fired  = 0
+   local timers = {}
+   local fn     = function() fired = fired + 1 end
+   for i = 1, n do
+      timers[i] = ev.Timer.new(fn, 0)
+      timers[i]:start(loop)
+   end
+   loop:loop()
+   return fired
+end)
+
+-- One repeating timer firing back to back:
+bench.run("timer_repeat_fire", bench.n(100000), function(n)
+   local fired = 0
+   local rep = ev.Timer.new(function(loop, timer)
+      fired = fired + 1
+      if fired >= n then timer:stop(loop) end
+   end, 1e-9, 1e-9)
+   rep:start(loop)
+   loop:loop()
+   return fired
+end)
+
+bench.memory("timer_memory", bench.n(100000), function()
+   return ev.Timer.new(noop, 60)
+end)
+
+local active = bench.memory("timer_active_memory", bench.n(100000), function()
+   local timer = ev.Timer.new(noop, 60)
+   timer:start(loop, true)
+   return timer
+end)
+for _, timer in ipairs(active) do
+   timer:stop(loop)
+end
+
+-- The same idle timeout workload on a timer wheel:
+local wheel = ev.TimerWheel.new(noop, loop, 1, 64)
+bench.run("wheel_add_cancel", bench.n(500000), function(n)
+   for i = 1, n do
+      wheel:add(i, 60)
+      wheel:cancel(i)
+   end
+end)
+
+bench.run("wheel_reset", bench.n(500000), function(n)
+   wheel:add(1, 60)
+   for i = 1, n do
+      wheel:reset(1)
+   end
+   wheel:cancel(1)
+end)
+
+bench.memory("wheel_timeout_memory", bench.n(100000), function(i)
+   wheel:add(i, 60)
+   return i
+end)
+for i = 1, bench.n(100000) do
+   wheel:cancel(i)
+end
+
+-- Push back an idle timeout as timer_again does above:
+local timeout = ev.Timeout.new(noop, 60)
+bench.run("timeout_touch", bench.n(500000), function(n)
+   timeout:start(loop)
+   for i = 1, n do
+      timeout:touch()
+   end
+   timeout:stop(loop)
+end)
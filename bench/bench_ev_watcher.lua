@@ -0,0 +1,111 @@
+local src_dir, build_dir = ...
+package.path  = src_dir .. "?.lua;" .. package.path
+package.cpath = build_dir .. "?.so;" .. package.cpath
+
+local ev    = require("ev")
+local bench = require("bench")
+
+local noop  = function() end
+local timer = ev.Timer.new(noop, 60)
+
+bench.run("watcher_callback_get", bench.n(1000000), function(n)
+   for i = 1, n do
+      timer:callback()
+   end
+end)
+
+bench.run("watcher_callback_set", bench.n(1000000), function(n)
+   for i = 1, n do
+      timer:callback(noop)
+   end
+end)
+
+bench.run("watcher_priority_get", bench.n(1000000), function(n)
+   for i = 1, n do
+      timer:priority()
+   end
+end)
+
+bench.run("watcher_is_active", bench.n(1000000), function(n)
+   for i = 1, n do
+      timer:is_active()
+   end
+end)
+
+local loop = ev.Loop.new()
+bench.run("watcher_start_stop", bench.n(1000000), function(n)
+   for i = 1, n do
+      timer:start(loop)
+      timer:stop(loop)
+   end
+end)
+
+timer:bind(loop)
+bench.run("watcher_start_stop_bound", bench.n(1000000), function(n)
+   for i = 1, n do
+      timer:start()
+      timer:stop()
+   end
+end)
+timer:bind(nil)
+
+timer.user_data = true
+bench.run("watcher_shadow_get", bench.n(1000000), function(n)
+   for i = 1, n do
+      local _ = timer.user_data
+   end
+end)
+
+-- Bytes per idle watcher, without and with a shadow table field, and
+-- per idle connection holding an io and a timer watcher (plus the
+-- table tying them together).  Use these to size hosts:
+bench.memory("watcher_memory", bench.n(100000), function()
+   return ev.Timer.new(noop, 60)
+end)
+
+bench.memory("watcher_shadow_memory", bench.n(100000), function()
+   local timer = ev.Timer.new(noop, 60)
+   timer.user_data = true
+   return timer
+end)
+
+bench.memory("connection_memory", bench.n(100000), function()
+   return { ev.IO.new(noop, 0, ev.READ), ev.Timer.new(noop, 60) }
+end)
+
+-- Tearing down connections made of a read and a write io and a
+-- timeout, one stop per watcher vs one group:stop() per connection:
+local conns = {}
+for i = 1, 1000 do
+   local read, write = ev.IO.new(noop, 0, ev.READ), ev.IO.new(noop, 1, ev.WRITE)
+   local timer = ev.Timer.new(noop, 60)
+   conns[i] = { read, write, timer, group = ev.Group.new(read, write, timer) }
+end
+
+bench.run("connection_stop_each", bench.n(100000), function(n)
+   local done = 0
+   while done < n do
+      for i = 1, #conns do
+         local conn = conns[i]
+         conn.group:start(loop)
+         conn[1]:stop(loop)
+         conn[2]:stop(loop)
+         conn[3]:stop(loop)
+      end
+      done = done + #conns
+   end
+   return done
+end)
+
+bench.run("connection_stop_group", bench.n(100000), function(n)
+   local done = 0
+   while done < n do
+      for i = 1, #conns do
+         local conn = conns[i]
+         conn.group:start(loop)
+         conn.group:stop(loop)
+      end
+      done = done + #conns
+   end
+   return done
+end)
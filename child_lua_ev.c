@@ -67,7 +67,7 @@ static int child_new(lua_State* L) {
     int         trace = luaL_checkbool(L, 3);
     ev_child*   child;
 
-    child = watcher_new(L, sizeof(ev_child), CHILD_MT);
+    child = watcher_new(L, sizeof(ev_child), CHILD_MT, OBJ_CHILD);
     ev_child_init(child, &child_cb, pid, trace);
     return 1;
 }
@@ -93,7 +93,7 @@ static int child_stop(lua_State *L) {
     ev_child*       child  = check_child(L, 1);
     struct ev_loop* loop = *check_loop_and_init(L, 2);
 
-    loop_stop_watcher(L, 2, 1);
+    loop_stop_watcher(L, 1);
     ev_child_stop(loop, child);
 
     return 0;
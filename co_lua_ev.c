@@ -0,0 +1,370 @@
+/**
+ * Upvalues shared by all the ev.co functions: the pools of idle
+ * timer and io watchers, and the co_wakeup() closure that is the
+ * callback of every pooled watcher.
+ */
+#define CO_TIMERS lua_upvalueindex(1)
+#define CO_IOS    lua_upvalueindex(2)
+#define CO_WAKEUP lua_upvalueindex(3)
+
+/**
+ * Create the ev.co table of coroutine-aware functions that suspend
+ * the running coroutine until a watcher fires.
+ *
+ * [-0, +1, ?]
+ */
+static int luaopen_ev_co(lua_State *L) {
+
+    static luaL_Reg fns[] = {
+        { "sleep",         co_sleep },
+        { "readable",      co_readable },
+        { "wait",          co_wait },
+        { NULL, NULL }
+    };
+    luaL_Reg* fn;
+
+    lua_createtable(L, 0, 3);
+
+    lua_newtable(L);
+    lua_newtable(L);
+    lua_pushvalue(L, -2);
+    lua_pushvalue(L, -2);
+    lua_pushcclosure(L, co_wakeup, 2);
+
+    /* STACK: <ev.co>, <timers>, <ios>, <wakeup> */
+    for ( fn = fns; fn->name; ++fn ) {
+        lua_pushvalue(L, -3);
+        lua_pushvalue(L, -3);
+        lua_pushvalue(L, -3);
+        lua_pushcclosure(L, fn->func, 3);
+        lua_setfield(L, -5, fn->name);
+    }
+    lua_pop(L, 3);
+
+    return 1;
+}
+
+/**
+ * Raise an error unless the running thread may yield.
+ *
+ * [-0, +0, v]
+ */
+static void co_check_yieldable(lua_State *L) {
+#if LUA_VERSION_NUM > 502
+    if ( lua_isyieldable(L) ) return;
+#else
+    int is_main = lua_pushthread(L);
+    lua_pop(L, 1);
+    if ( ! is_main ) return;
+#endif
+    luaL_error(L, "ev.co functions must be called from a coroutine");
+}
+
+/**
+ * Resume co with the nargs values on top of its stack and discard
+ * whatever it yields or returns.  On error the error object is left
+ * on the stack of co.
+ */
+static int co_resume(lua_State *co, lua_State *from, int nargs) {
+    int status;
+#if LUA_VERSION_NUM > 503
+    int nres;
+    status = lua_resume(co, from, nargs, &nres);
+    if ( LUA_YIELD == status || 0 == status ) lua_pop(co, nres);
+#elif LUA_VERSION_NUM > 501
+    status = lua_resume(co, from, nargs);
+    if ( LUA_YIELD == status || 0 == status ) lua_settop(co, 0);
+#else
+    (void)from;
+    status = lua_resume(co, nargs);
+    if ( LUA_YIELD == status || 0 == status ) lua_settop(co, 0);
+#endif
+    return status;
+}
+
+/**
+ * Push an idle watcher from the pool at pool_i, creating a new one
+ * with new_fn(wakeup, ...) if the pool is empty.  The watcher is not
+ * initialized for any particular event yet.
+ *
+ * [-0, +1, e]
+ */
+static void* co_acquire(lua_State *L, int pool_i, lua_CFunction new_fn) {
+    int n = (int)lua_rawlen(L, pool_i);
+
+    if ( n > 0 ) {
+        lua_rawgeti(L, pool_i, n);
+        lua_pushnil(L);
+        lua_rawseti(L, pool_i, n);
+    } else {
+        lua_pushcfunction(L, new_fn);
+        lua_pushvalue(L, CO_WAKEUP);
+        if ( new_fn == io_new ) {
+            lua_pushinteger(L, 0);
+            lua_pushinteger(L, EV_READ);
+            lua_call(L, 3, 1);
+        } else {
+            lua_pushnumber(L, 0);
+            lua_call(L, 2, 1);
+        }
+    }
+    return lua_touserdata(L, -1);
+}
+
+/**
+ * Stop the pooled watcher at watcher_i, forget the coroutine waiting
+ * on it and put it back into its pool.
+ *
+ * [-0, +0, m]
+ */
+static void co_release(lua_State *L, int loop_i, int watcher_i) {
+    struct ev_loop* loop = *(struct ev_loop**)lua_touserdata(L, loop_i);
+    ev_watcher*     w    = (ev_watcher*)lua_touserdata(L, watcher_i);
+    int             pool_i;
+
+    watcher_i = lua_absindex(L, watcher_i);
+
+    loop_stop_watcher(L, watcher_i);
+    if ( w->cb == (void*)&io_cb ) {
+        ev_io_stop(loop, (ev_io*)w);
+        pool_i = CO_IOS;
+    } else {
+        ev_timer_stop(loop, (ev_timer*)w);
+        pool_i = CO_TIMERS;
+    }
+
+    watcher_push_fenv(L, watcher_i, 1);
+    lua_pushnil(L);
+    lua_rawseti(L, -2, WATCHER_CO);
+    lua_pushnil(L);
+    lua_rawseti(L, -2, WATCHER_CO_PEER);
+    lua_pop(L, 1);
+
+    lua_pushvalue(L, watcher_i);
+    lua_rawseti(L, pool_i, (int)lua_rawlen(L, pool_i) + 1);
+}
+
+/**
+ * Record the running coroutine (and optionally a peer watcher) in the
+ * fenv of the watcher at watcher_i.
+ *
+ * [-0, +0, m]
+ */
+static void co_park(lua_State *L, int watcher_i, int peer_i) {
+    watcher_i = lua_absindex(L, watcher_i);
+    peer_i    = peer_i ? lua_absindex(L, peer_i) : 0;
+
+    watcher_push_fenv(L, watcher_i, 1);
+    lua_pushthread(L);
+    lua_rawseti(L, -2, WATCHER_CO);
+    if ( peer_i ) {
+        lua_pushvalue(L, peer_i);
+        lua_rawseti(L, -2, WATCHER_CO_PEER);
+    }
+    lua_pop(L, 1);
+}
+
+/**
+ * The callback of every watcher a coroutine waits on.  Releases the
+ * pooled watchers involved and resumes the coroutine with the result
+ * of the wait.  Errors raised by the coroutine are propagated so they
+ * are reported like any other callback error.
+ *
+ *   1 - loop object.
+ *   2 - watcher object.
+ *   3 - revents.
+ *
+ * [-0, +0, e]
+ */
+static int co_wakeup(lua_State *L) {
+    ev_watcher* w = (ev_watcher*)lua_touserdata(L, 2);
+    lua_State*  co;
+    int         status;
+
+    lua_settop(L, 3);
+    watcher_push_fenv(L, 2, 1);
+    lua_rawgeti(L, 4, WATCHER_CO);
+    lua_rawgeti(L, 4, WATCHER_CO_PEER);
+
+    /* STACK: <loop>, <watcher>, <revents>, <fenv>, <co>, <peer> */
+
+    co = lua_tothread(L, 5);
+
+    if ( w->cb == (void*)&async_cb ) {
+        /* Give the async its own callback back: */
+        watcher_set_fn(L, 2);
+        lua_pushnil(L);
+        lua_rawseti(L, 4, WATCHER_CO);
+        lua_pushnil(L);
+        lua_rawseti(L, 4, WATCHER_CO_PEER);
+        lua_pushvalue(L, 3);
+    } else {
+        int has_peer = ! lua_isnil(L, 6);
+
+        co_release(L, 1, 2);
+        if ( has_peer ) co_release(L, 1, 6);
+
+        /* Only a timeout on ev.co.readable() is a failed wait: */
+        lua_pushboolean(L, ! ( has_peer && w->cb == (void*)&timer_cb ));
+    }
+
+    if ( NULL == co ) return 0;
+    if ( LUA_YIELD != lua_status(co) )
+        return luaL_error(L, "coroutine waiting on a watcher is not suspended");
+
+    lua_xmove(L, co, 1);
+    status = co_resume(co, L, 1);
+    if ( LUA_YIELD != status && 0 != status ) {
+        lua_xmove(co, L, 1);
+        return lua_error(L);
+    }
+    return 0;
+}
+
+/**
+ * Called when the async at watcher_i is stopped.  If a coroutine waits
+ * on it in ev.co.wait(), the async gets its own callback back and the
+ * coroutine is resumed with nil, rather than waiting forever.  Errors
+ * raised by the coroutine are propagated.
+ *
+ * [-0, +0, e]
+ */
+static void co_cancel(lua_State *L, int watcher_i) {
+    lua_State* co;
+    int        status;
+
+    watcher_i = lua_absindex(L, watcher_i);
+    if ( ! watcher_push_fenv(L, watcher_i, 0) ) {
+        lua_pop(L, 1);
+        return;
+    }
+    lua_rawgeti(L, -1, WATCHER_CO);
+    co = lua_tothread(L, -1);
+    if ( NULL == co ) {
+        lua_pop(L, 2);
+        return;
+    }
+
+    /* STACK: <fenv>, <co> (which keeps the coroutine alive) */
+
+    lua_rawgeti(L, -2, WATCHER_CO_PEER);
+    watcher_set_fn(L, watcher_i);
+    lua_pushnil(L);
+    lua_rawseti(L, -3, WATCHER_CO);
+    lua_pushnil(L);
+    lua_rawseti(L, -3, WATCHER_CO_PEER);
+
+    if ( LUA_YIELD == lua_status(co) ) {
+        lua_pushnil(co);
+        status = co_resume(co, L, 1);
+        if ( LUA_YIELD != status && 0 != status ) {
+            lua_xmove(co, L, 1);
+            lua_error(L);
+        }
+    }
+    lua_pop(L, 2);
+}
+
+/**
+ * Suspend the running coroutine for the given number of seconds.
+ *
+ * Usage:
+ *   ev.co.sleep(loop, seconds)
+ *
+ * [-0, +0, e]
+ */
+static int co_sleep(lua_State *L) {
+    struct ev_loop* loop  = *check_loop_and_init(L, 1);
+    ev_tstamp       after = luaL_checknumber(L, 2);
+    ev_timer*       timer;
+
+    co_check_yieldable(L);
+    lua_settop(L, 2);
+
+    timer = co_acquire(L, CO_TIMERS, timer_new);
+    ev_timer_set(timer, after, 0);
+    ev_timer_start(loop, timer);
+    loop_start_watcher(L, 1, 3, 0);
+    co_park(L, 3, 0);
+
+    return lua_yield(L, 0);
+}
+
+/**
+ * Suspend the running coroutine until fd is readable, or until
+ * timeout seconds have passed.  Returns true if fd is readable and
+ * false on timeout.
+ *
+ * Usage:
+ *   is_readable = ev.co.readable(loop, fd [, timeout])
+ *
+ * [-0, +1, e]
+ */
+static int co_readable(lua_State *L) {
+    struct ev_loop* loop = *check_loop_and_init(L, 1);
+#if LUA_VERSION_NUM > 502
+    int             fd   = (int)luaL_checkinteger(L, 2);
+#else
+    int             fd   = luaL_checkint(L, 2);
+#endif
+    int             has_timeout = ! lua_isnoneornil(L, 3);
+    ev_tstamp       timeout     = has_timeout ? luaL_checknumber(L, 3) : 0;
+    ev_io*          io;
+
+    co_check_yieldable(L);
+    lua_settop(L, 3);
+
+    io = co_acquire(L, CO_IOS, io_new);
+    ev_io_set(io, fd, EV_READ);
+    ev_io_start(loop, io);
+    loop_start_watcher(L, 1, 4, 0);
+
+    if ( has_timeout ) {
+        ev_timer* timer = co_acquire(L, CO_TIMERS, timer_new);
+        ev_timer_set(timer, timeout, 0);
+        ev_timer_start(loop, timer);
+        loop_start_watcher(L, 1, 5, 0);
+        co_park(L, 5, 4);
+        co_park(L, 4, 5);
+    } else {
+        co_park(L, 4, 0);
+    }
+
+    return lua_yield(L, 0);
+}
+
+/**
+ * Suspend the running coroutine until the (started) async watcher is
+ * signaled.  While a coroutine waits, it takes the place of the async
+ * callback for one event.  Returns the revents, or nil if the async
+ * was stopped in the meantime (see co_cancel()).
+ *
+ * Usage:
+ *   revents = ev.co.wait(async)
+ *
+ * [-0, +1, e]
+ */
+static int co_wait(lua_State *L) {
+    ev_async* async = check_async(L, 1);
+
+    co_check_yieldable(L);
+    if ( ! ev_is_active(async) )
+        luaL_argerror(L, 1, "async watcher must be started");
+
+    watcher_push_fenv(L, 1, 1);
+    lua_rawgeti(L, -1, WATCHER_CO);
+    if ( ! lua_isnil(L, -1) )
+        luaL_argerror(L, 1, "a coroutine is already waiting on this async");
+    lua_pop(L, 1);
+
+    /* Park the callback and take its place: */
+    watcher_push_fn(L, 1);
+    lua_rawseti(L, -2, WATCHER_CO_PEER);
+    lua_pushvalue(L, CO_WAKEUP);
+    watcher_set_fn(L, 1);
+    lua_pushthread(L);
+    lua_rawseti(L, -2, WATCHER_CO);
+    lua_pop(L, 1);
+
+    return lua_yield(L, 0);
+}
@@ -6,23 +6,9 @@
 --
 -- WARNING!! WARNING!! WARNING!! WARNING!! WARNING!! WARNING!! WARNING!! WARNING!! 
 --
--- Want something safer? Feel free to contribute!
---
--- One idea is to allocate all ev_loop and ev_async objects into a pool shared
--- shared across all uses of this library (aka a statically allocated array). This
--- pool would also contain reference counts for each object.
---
--- The userdata objects for loop and async watchers could then be changed to
--- reference the index into that pool.
---
--- We could then "serialize" an ev_loop or ev_async object by returning the index.
---
--- The "deserialize" would allocate an userdata that points to this index and
--- increment the reference count (assuming that an object of the correct type
--- exists at this index, otherwise throw an error).
---
--- Note that all allocations (and deallocations) of loop and async watchers would
--- require a mutex to ensure only one thread modifies this data at one time.
+-- Want something safer? Use async:export() and ev.Async.import() which are
+-- built into the C module: they keep exported async watchers in a mutex
+-- protected, reference counted pool so senders never touch freed memory.
 
 
 
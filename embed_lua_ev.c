@@ -0,0 +1,177 @@
+/**
+ * The embed userdata.  Besides the ev_embed itself it holds a prepare
+ * watcher which, once per iteration of the outer loop, copies the
+ * lua_State of the outer loop into the embedded loop.  libev may run
+ * the embedded loop from its own (lower priority) prepare watcher,
+ * so the embedded loop must always know where to run its callbacks.
+ */
+typedef struct {
+    ev_embed   embed;     /* must be first, see check_embed() */
+    ev_prepare prepare;
+} evlua_embed;
+
+/**
+ * Create a table for ev.Embed that gives access to the constructor for
+ * embed objects.
+ *
+ * [-0, +1, ?]
+ */
+static int luaopen_ev_embed(lua_State *L) {
+    lua_pop(L, create_embed_mt(L));
+
+    lua_createtable(L, 0, 1);
+
+    lua_pushcfunction(L, embed_new);
+    lua_setfield(L, -2, "new");
+
+    return 1;
+}
+
+/**
+ * Create the embed metatable in the registry.
+ *
+ * [-0, +1, ?]
+ */
+static int create_embed_mt(lua_State *L) {
+
+    static luaL_Reg fns[] = {
+        { "stop",          embed_stop },
+        { "start",         embed_start },
+        { "sweep",         embed_sweep },
+        { NULL, NULL }
+    };
+    luaL_newmetatable(L, EMBED_MT);
+    add_watcher_mt(L);
+    luaL_setfuncs(L, fns, 0);
+
+    return 1;
+}
+
+/**
+ * Create a new embed object.  Arguments:
+ *   1 - callback function.
+ *   2 - loop to embed, its backend must be one of
+ *       ev.embeddable_backends().
+ *
+ * @see watcher_new()
+ *
+ * [+1, -0, ?]
+ */
+static int embed_new(lua_State* L) {
+    struct ev_loop* other = *check_loop_and_init(L, 2);
+    evlua_embed*    embed;
+
+    if ( ! ( ev_backend(other) & ev_embeddable_backends() ) )
+        luaL_argerror(L, 2, "loop backend is not embeddable");
+
+    embed = watcher_new(L, sizeof(evlua_embed), EMBED_MT, OBJ_EMBED);
+    ev_embed_init(&embed->embed, &embed_cb, other);
+    ev_prepare_init(&embed->prepare, &embed_prepare_cb);
+    ev_set_priority(&embed->prepare, EV_MAXPRI);
+
+    /* Keep the embedded loop alive: */
+    watcher_push_fenv(L, -1, 1);
+    lua_pushvalue(L, 2);
+    lua_rawseti(L, -2, WATCHER_EMBED_LOOP);
+    lua_pop(L, 1);
+
+    return 1;
+}
+
+/**
+ * Sweeps the embedded loop in the lua_State of the outer loop and
+ * then invokes the lua callback, so on_embed is only a notification.
+ *
+ * @see watcher_cb()
+ *
+ * [+0, -0, m]
+ */
+static void embed_cb(struct ev_loop* loop, ev_embed* embed, int revents) {
+    ev_set_userdata(embed->other, ev_userdata(loop));
+    ev_embed_sweep(loop, embed);
+
+    /* The sweep may have stopped this embed: */
+    if ( LUA_NOREF != WATCHER_EXT(embed)->ref ) {
+        watcher_cb(loop, embed, revents);
+    }
+}
+
+/**
+ * @see evlua_embed
+ */
+static void embed_prepare_cb(struct ev_loop* loop, ev_prepare* prepare, int revents) {
+    evlua_embed* embed = (evlua_embed*)
+        ((char*)prepare - offsetof(evlua_embed, prepare));
+
+    ev_set_userdata(embed->embed.other, ev_userdata(loop));
+}
+
+/**
+ * Stops the embed so it won't be called by the specified event loop.
+ *
+ * Usage:
+ *     embed:stop(loop)
+ *
+ * [+0, -0, e]
+ */
+static int embed_stop(lua_State *L) {
+    evlua_embed*    embed = (evlua_embed*)check_embed(L, 1);
+    struct ev_loop* loop  = *check_loop_and_init(L, 2);
+
+    loop_stop_watcher(L, 1);
+    if ( ev_is_active(&embed->prepare) ) {
+        ev_ref(loop);
+        ev_prepare_stop(loop, &embed->prepare);
+    }
+    ev_embed_stop(loop, &embed->embed);
+
+    return 0;
+}
+
+/**
+ * Starts the embed so it will be called by the specified event loop.
+ *
+ * Usage:
+ *     embed:start(loop [, is_daemon])
+ *
+ * [+0, -0, e]
+ */
+static int embed_start(lua_State *L) {
+    evlua_embed*    embed = (evlua_embed*)check_embed(L, 1);
+    struct ev_loop* loop  = *check_loop_and_init(L, 2);
+    int is_daemon         = lua_toboolean(L, 3);
+
+    if ( loop == embed->embed.other )
+        luaL_argerror(L, 2, "a loop can not be embedded into itself");
+
+    ev_embed_start(loop, &embed->embed);
+    if ( ! ev_is_active(&embed->prepare) ) {
+        ev_prepare_start(loop, &embed->prepare);
+        /* Internal helper, must not keep the loop alive: */
+        ev_unref(loop);
+    }
+    loop_start_watcher(L, 2, 1, is_daemon);
+
+    return 0;
+}
+
+/**
+ * Make a single, non-blocking sweep over the embedded loop, invoking
+ * its pending callbacks.
+ *
+ * Usage:
+ *     embed:sweep(loop)
+ *
+ * [+0, -0, e]
+ */
+static int embed_sweep(lua_State *L) {
+    ev_embed*       embed = check_embed(L, 1);
+    struct ev_loop* loop  = *check_loop_and_init(L, 2);
+    void*           old_userdata = ev_userdata(embed->other);
+
+    ev_set_userdata(embed->other, L);
+    ev_embed_sweep(loop, embed);
+    ev_set_userdata(embed->other, old_userdata);
+
+    return 0;
+}
@@ -0,0 +1,340 @@
+/**
+ * Create a table for ev.Group that gives access to the constructor
+ * for group objects.
+ *
+ * [-0, +1, ?]
+ */
+static int luaopen_ev_group(lua_State *L) {
+    lua_pop(L, create_group_mt(L));
+
+    lua_createtable(L, 0, 1);
+
+    lua_pushcfunction(L, group_new);
+    lua_setfield(L, -2, "new");
+
+    return 1;
+}
+
+/**
+ * Create the group metatable in the registry.
+ *
+ * [-0, +1, ?]
+ */
+static int create_group_mt(lua_State *L) {
+
+    static luaL_Reg fns[] = {
+        { "add",           group_add },
+        { "remove",        group_remove },
+        { "count",         group_count },
+        { "start",         group_start },
+        { "stop",          group_stop },
+        { "set_priority",  group_set_priority },
+        { NULL, NULL }
+    };
+    luaL_newmetatable(L, GROUP_MT);
+    luaL_setfuncs(L, fns, 0);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+
+    return 1;
+}
+
+/**
+ * Create a new group of watchers of any type, optionally with some
+ * initial watchers.  The watchers are kept in the fenv of the group.
+ *
+ * Usage:
+ *   group = ev.Group.new([watcher, ...])
+ *
+ * [+1, -0, e]
+ */
+static int group_new(lua_State *L) {
+    obj_new(L, 0, GROUP_MT, OBJ_GROUP);
+    lua_insert(L, 1);
+    return group_add(L);
+}
+
+/**
+ * Raises an error unless the watcher at watcher_i has a name method,
+ * which group_call() relies on.  Pushes that method.
+ *
+ * [-0, +1, e]
+ */
+static void group_check_method(lua_State *L, int watcher_i, const char* name) {
+    const char* type;
+
+    if ( luaL_getmetafield(L, watcher_i, name) ) return;
+
+    /* Metatables only have a __name since lua 5.3: */
+    type = luaL_getmetafield(L, watcher_i, "__name") && lua_isstring(L, -1) ?
+        lua_tostring(L, -1) : luaL_typename(L, watcher_i);
+    luaL_error(L, "watcher type %s can not be grouped", type);
+}
+
+/**
+ * Adds watchers to the group.  Returns the group so it can be chained
+ * to the constructor.  Watchers without start and stop methods (like
+ * ev.TimerWheel) can not be grouped.
+ *
+ * Usage:
+ *   group = group:add(watcher, ...)
+ *
+ * [+1, -0, e]
+ */
+static int group_add(lua_State *L) {
+    int top = lua_gettop(L);
+    int n;
+    int i;
+
+    check_group(L, 1);
+    for ( i = 2; i <= top; i++ ) {
+        check_watcher(L, i);
+        group_check_method(L, i, "start");
+        group_check_method(L, i, "stop");
+        lua_pop(L, 2);
+    }
+
+    lua_getuservalue(L, 1);
+    n = (int)lua_rawlen(L, -1);
+    for ( i = 2; i <= top; i++ ) {
+        lua_pushvalue(L, i);
+        lua_rawseti(L, -2, ++n);
+    }
+
+    lua_pushvalue(L, 1);
+    return 1;
+}
+
+/**
+ * Removes a watcher from the group, without stopping it.  Returns
+ * false if it was not in the group.
+ *
+ * Usage:
+ *   bool = group:remove(watcher)
+ *
+ * [+1, -0, e]
+ */
+static int group_remove(lua_State *L) {
+    int n;
+    int i;
+
+    check_group(L, 1);
+    check_watcher(L, 2);
+    lua_settop(L, 2);
+    lua_getuservalue(L, 1);
+    n = (int)lua_rawlen(L, 3);
+
+    for ( i = 1; i <= n; i++ ) {
+        lua_rawgeti(L, 3, i);
+        if ( lua_rawequal(L, 2, -1) ) break;
+        lua_pop(L, 1);
+    }
+    if ( i > n ) {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+
+    /* Close the gap, keeping the order: */
+    for ( ; i < n; i++ ) {
+        lua_rawgeti(L, 3, i + 1);
+        lua_rawseti(L, 3, i);
+    }
+    lua_pushnil(L);
+    lua_rawseti(L, 3, n);
+
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+/**
+ * Returns the number of watchers in the group.
+ *
+ * Usage:
+ *   count = group:count()
+ *
+ * [+1, -0, e]
+ */
+static int group_count(lua_State *L) {
+    check_group(L, 1);
+    lua_getuservalue(L, 1);
+    lua_pushinteger(L, (lua_Integer)lua_rawlen(L, -1));
+    return 1;
+}
+
+/**
+ * Calls the name method of the watcher at watcher_i with the group
+ * method arguments at 2 and 3 (loop, is_daemon or priority).  Used
+ * for watcher types that do more than ev_TYPE_start(), ev_TYPE_stop()
+ * or ev_set_priority().
+ *
+ * [-0, +0, e]
+ */
+static void group_call(lua_State *L, int watcher_i, const char* name) {
+    group_check_method(L, watcher_i, name);
+    lua_pushvalue(L, watcher_i);
+    lua_pushvalue(L, 2);
+    lua_pushvalue(L, 3);
+    lua_call(L, 3, 0);
+}
+
+/**
+ * Starts all the watchers of the group in the loop, like calling
+ * watcher:start(loop [, is_daemon]) on each of them, in one call.
+ *
+ * Usage:
+ *   group:start(loop [, is_daemon])
+ *
+ * [+0, -0, e]
+ */
+static int group_start(lua_State *L) {
+    struct ev_loop* loop;
+    int             is_daemon;
+    int             n;
+    int             i;
+
+    check_group(L, 1);
+    loop      = *check_loop_and_init(L, 2);
+    is_daemon = lua_toboolean(L, 3);
+    lua_settop(L, 3);
+    lua_getuservalue(L, 1);
+    n = (int)lua_rawlen(L, 4);
+
+    for ( i = 1; i <= n; i++ ) {
+        void* w;
+
+        lua_rawgeti(L, 4, i);
+        w = lua_touserdata(L, 5);
+        switch ( obj_type(L, 5) ) {
+        case OBJ_IO:       ev_io_start(loop, (ev_io*)w);             break;
+        case OBJ_TIMER:    ev_timer_start(loop, (ev_timer*)w);       break;
+        case OBJ_SIGNAL:   ev_signal_start(loop, (ev_signal*)w);     break;
+        case OBJ_IDLE:     ev_idle_start(loop, (ev_idle*)w);         break;
+        case OBJ_CHILD:    ev_child_start(loop, (ev_child*)w);       break;
+        case OBJ_STAT:     ev_stat_start(loop, (ev_stat*)w);         break;
+        case OBJ_PERIODIC: ev_periodic_start(loop, (ev_periodic*)w); break;
+        case OBJ_PREPARE:  ev_prepare_start(loop, (ev_prepare*)w);   break;
+        case OBJ_CHECK:    ev_check_start(loop, (ev_check*)w);       break;
+        case OBJ_ASYNC:
+            ev_async_start(loop, (ev_async*)w);
+            async_pool_set_loop((ev_async*)w, loop);
+            break;
+        default:
+            group_call(L, 5, "start");
+            lua_pop(L, 1);
+            continue;
+        }
+        loop_start_watcher(L, 2, 5, is_daemon);
+        lua_pop(L, 1);
+    }
+    return 0;
+}
+
+/**
+ * Stops all the watchers of the group, like calling
+ * watcher:stop(loop) on each of them, in one call.
+ *
+ * Usage:
+ *   group:stop(loop)
+ *
+ * [+0, -0, e]
+ */
+static int group_stop(lua_State *L) {
+    struct ev_loop* loop;
+    int             n;
+    int             i;
+
+    check_group(L, 1);
+    loop = *check_loop_and_init(L, 2);
+    lua_settop(L, 3);
+    lua_getuservalue(L, 1);
+    n = (int)lua_rawlen(L, 4);
+
+    for ( i = 1; i <= n; i++ ) {
+        void* w;
+
+        lua_rawgeti(L, 4, i);
+        w = lua_touserdata(L, 5);
+        switch ( obj_type(L, 5) ) {
+        case OBJ_IO:       ev_io_stop(loop, (ev_io*)w);             break;
+        case OBJ_TIMER:    ev_timer_stop(loop, (ev_timer*)w);       break;
+        case OBJ_SIGNAL:   ev_signal_stop(loop, (ev_signal*)w);     break;
+        case OBJ_IDLE:     ev_idle_stop(loop, (ev_idle*)w);         break;
+        case OBJ_CHILD:    ev_child_stop(loop, (ev_child*)w);       break;
+        case OBJ_STAT:     ev_stat_stop(loop, (ev_stat*)w);         break;
+        case OBJ_PERIODIC: ev_periodic_stop(loop, (ev_periodic*)w); break;
+        case OBJ_PREPARE:  ev_prepare_stop(loop, (ev_prepare*)w);   break;
+        case OBJ_CHECK:    ev_check_stop(loop, (ev_check*)w);       break;
+        case OBJ_ASYNC:
+            async_pool_set_loop((ev_async*)w, NULL);
+            ev_async_stop(loop, (ev_async*)w);
+            co_cancel(L, 5);
+            break;
+        default:
+            group_call(L, 5, "stop");
+            lua_pop(L, 1);
+            continue;
+        }
+        loop_stop_watcher(L, 5);
+        lua_pop(L, 1);
+    }
+    return 0;
+}
+
+/**
+ * Sets the priority of all the watchers of the group, like calling
+ * watcher:priority(priority) on each of them.  libev only allows
+ * changing the priority of watchers that are neither active nor
+ * pending, so this fails without changing anything if any of them is.
+ *
+ * Usage:
+ *   group:set_priority(priority)
+ *
+ * [+0, -0, e]
+ */
+static int group_set_priority(lua_State *L) {
+    int n;
+    int i;
+#if LUA_VERSION_NUM > 502
+    int priority = (int)luaL_checkinteger(L, 2);
+#else
+    int priority = luaL_checkint(L, 2);
+#endif
+
+    check_group(L, 1);
+    lua_settop(L, 3);
+    lua_getuservalue(L, 1);
+    n = (int)lua_rawlen(L, 4);
+
+    for ( i = 1; i <= n; i++ ) {
+        ev_watcher* w;
+
+        lua_rawgeti(L, 4, i);
+        w = (ev_watcher*)lua_touserdata(L, 5);
+        if ( ev_is_active(w) || ev_is_pending(w) ) {
+            return luaL_error(L, "can not change the priority of active or pending watcher %d", i);
+        }
+        lua_pop(L, 1);
+    }
+    for ( i = 1; i <= n; i++ ) {
+        lua_rawgeti(L, 4, i);
+        switch ( obj_type(L, 5) ) {
+        case OBJ_IO:
+        case OBJ_TIMER:
+        case OBJ_SIGNAL:
+        case OBJ_IDLE:
+        case OBJ_CHILD:
+        case OBJ_STAT:
+        case OBJ_PERIODIC:
+        case OBJ_PREPARE:
+        case OBJ_CHECK:
+        case OBJ_ASYNC:
+            ev_set_priority((ev_watcher*)lua_touserdata(L, 5), priority);
+            break;
+        default:
+            group_call(L, 5, "priority");
+            break;
+        }
+        lua_pop(L, 1);
+    }
+    return 0;
+}
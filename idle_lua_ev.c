@@ -45,7 +45,7 @@ static int create_idle_mt(lua_State *L) {
 static int idle_new(lua_State* L) {
     ev_idle*  idle;
 
-    idle = watcher_new(L, sizeof(ev_idle), IDLE_MT);
+    idle = watcher_new(L, sizeof(ev_idle), IDLE_MT, OBJ_IDLE);
     ev_idle_init(idle, &idle_cb);
     return 1;
 }
@@ -71,7 +71,7 @@ static int idle_stop(lua_State *L) {
     ev_idle*        idle   = check_idle(L, 1);
     struct ev_loop* loop   = *check_loop_and_init(L, 2);
 
-    loop_stop_watcher(L, 2, 1);
+    loop_stop_watcher(L, 1);
     ev_idle_stop(loop, idle);
 
     return 0;
@@ -7,11 +7,14 @@
 static int luaopen_ev_io(lua_State *L) {
     lua_pop(L, create_io_mt(L));
 
-    lua_createtable(L, 0, 1);
+    lua_createtable(L, 0, 2);
 
     lua_pushcfunction(L, io_new);
     lua_setfield(L, -2, "new");
 
+    lua_pushcfunction(L, io_pool);
+    lua_setfield(L, -2, "pool");
+
     return 1;
 }
 
@@ -55,11 +58,24 @@ static int io_new(lua_State* L) {
 #endif
     ev_io*  io;
 
-    io = watcher_new(L, sizeof(ev_io), IO_MT);
+    io = watcher_new(L, sizeof(ev_io), IO_MT, OBJ_IO);
     ev_io_init(io, &io_cb, fd, events);
     return 1;
 }
 
+/**
+ * Create a pool of io watchers, see pool_acquire().  Arguments:
+ *   1 - max (most released watchers kept for reuse, default 64).
+ *
+ * Usage:
+ *   pool = ev.IO.pool([max])
+ *
+ * [+1, -0, e]
+ */
+static int io_pool(lua_State* L) {
+    return pool_new(L, OBJ_IO);
+}
+
 /**
  * @see watcher_cb()
  *
@@ -81,7 +97,7 @@ static int io_stop(lua_State *L) {
     ev_io*          io     = check_io(L, 1);
     struct ev_loop* loop   = *check_loop_and_init(L, 2);
 
-    loop_stop_watcher(L, 2, 1);
+    loop_stop_watcher(L, 1);
     ev_io_stop(loop, io);
 
     return 0;
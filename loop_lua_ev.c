@@ -1,3 +1,44 @@
+static char* loop_error_registry = "ev{loop_error}";
+
+static char* loop_refs = "ev{loop_refs}";
+
+/**
+ * The loop run by loop_run_flags() in this thread, for the libev
+ * hooks, see loop_hooked().
+ */
+static __thread evlua_loop* loop_running = NULL;
+
+/**
+ * Create the weak valued table that holds the loop references used by
+ * watcher_cb(), and store its registry ref so loop_alloc() can find
+ * it.  Registered watchers must not keep their loop alive.
+ *
+ * [-0, +0, m]
+ */
+static void create_loop_refs(lua_State *L) {
+    lua_newtable(L);
+
+    lua_createtable(L,  0, 1);
+    lua_pushliteral(L,   "v");
+    lua_setfield(L,     -2, "__mode");
+    lua_setmetatable(L, -2);
+
+    lua_pushlightuserdata(L, &loop_refs);
+    lua_pushinteger(L,       luaL_ref(L, LUA_REGISTRYINDEX));
+    lua_rawset(L,            LUA_REGISTRYINDEX);
+}
+
+/**
+ * Push the loop object of lp, found through its weak reference.
+ *
+ * [-0, +1, -]
+ */
+static void loop_push(lua_State *L, evlua_loop* lp) {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, lp->refs);
+    lua_rawgeti(L, -1, lp->ref);
+    lua_replace(L, -2);
+}
+
 /**
  * Create a table for ev.Loop that gives access to the constructor for
  * loop objects and the "default" event loop object instance.
@@ -26,17 +67,28 @@ static int luaopen_ev_loop(lua_State *L) {
 static int create_loop_mt(lua_State *L) {
 
     static luaL_Reg fns[] = {
-        { "is_default", loop_is_default },
-        { "count",      loop_iteration }, /* old API */
-        { "iteration",  loop_iteration },
-        { "depth",      loop_depth },
-        { "now",        loop_now },
-        { "update_now", loop_update_now },
-        { "loop",       loop_loop },
-        { "unloop",     loop_unloop },
-        { "backend",    loop_backend },
-        { "fork",       loop_fork },
-        { "__gc",       loop_delete },
+        { "is_default",               loop_is_default },
+        { "count",                    loop_iteration }, /* old API */
+        { "iteration",                loop_iteration },
+        { "depth",                    loop_depth },
+        { "now",                      loop_now },
+        { "update_now",               loop_update_now },
+        { "loop",                     loop_loop },
+        { "run",                      loop_run },
+        { "next_timeout",             loop_next_timeout },
+        { "unloop",                   loop_unloop },
+        { "backend",                  loop_backend },
+        { "fork",                     loop_fork },
+        { "io_collect_interval",      loop_io_collect_interval },
+        { "timeout_collect_interval", loop_timeout_collect_interval },
+        { "adaptive_collect",         loop_adaptive_collect },
+        { "stats",                    loop_stats },
+        { "profile",                  loop_profile },
+        { "top_watchers",             loop_top_watchers },
+        { "lag_probe",                loop_lag_probe },
+        { "latency",                  loop_latency },
+        { "on_error",                 loop_on_error },
+        { "__gc",                     loop_delete },
         { NULL, NULL }
     };
     luaL_newmetatable(L, LOOP_MT);
@@ -48,31 +100,66 @@ static int create_loop_mt(lua_State *L) {
 }
 
 /**
- * Create a table intended as the loop object, sets the metatable,
- * registers it, creates the evlua_loop struct appropriately, and sets
- * the userdata fenv to an empty table.  This table is used to store
- * references to active watchers so the garbage collector does not
- * prematurely collect the watchers.
+ * Create a userdata intended as the loop object, sets the metatable
+ * and initializes the evlua_loop struct appropriately.  The caller
+ * registers it once the ev_loop exists.
  *
  * [-0, +1, v]
  */
 static struct ev_loop** loop_alloc(lua_State *L) {
-    struct ev_loop** loop = (struct ev_loop**)
-        obj_new(L, sizeof(struct ev_loop*), LOOP_MT);
+    evlua_loop* lp = (evlua_loop*)obj_new(L, sizeof(evlua_loop), LOOP_MT, OBJ_LOOP);
 
-    return loop;
+    lp->loop            = NULL;
+    lp->watchers        = 0;
+    lp->active          = NULL;
+    lp->callbacks       = 0;
+    lp->read_buf        = NULL;
+    lp->read_buf_size   = 0;
+    lp->io_collect      = 0;
+    lp->timeout_collect = 0;
+    lp->adapt_max       = 0;
+    lp->profile         = 0;
+    lp->stats           = 0;
+    ev_prepare_init(&lp->adapt, &loop_adapt_cb);
+    ev_init(&lp->probe, &loop_probe_cb);
+    lp->probe.repeat    = 0;
+    memset(&lp->lag, 0, sizeof(evlua_latency));
+    memset(&lp->timer_late, 0, sizeof(evlua_latency));
+    lp->latency         = 0;
+    ev_async_init(&lp->work, &work_async_cb);
+    lp->work_done       = NULL;
+    lp->work_pending    = 0;
+    lp->work_inflight   = 0;
+    lp->work_ref        = LUA_NOREF;
+
+    lua_pushlightuserdata(L, &loop_refs);
+    lua_rawget(L,            LUA_REGISTRYINDEX);
+    lp->refs = (int)lua_tointeger(L, -1);
+    assert(0 != lp->refs /* create_loop_refs() should have ran */);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, lp->refs);
+    lua_pushvalue(L, -3);
+    lp->ref = luaL_ref(L, -2);
+    lua_pop(L, 2);
+
+    return &lp->loop;
 }
 
 /**
- * Validates that loop_i is a loop object and checks if it is the
+ * Validates that loop_i is a loop object (or missing, if the first
+ * argument is a watcher bound to a loop) and checks if it is the
  * special UNINITIALIZED_DEFAULT_LOOP token, and if so it initializes
  * the default loop.  If everything checks out fine, then a pointer to
  * the ev_loop object is returned.
  */
 static struct ev_loop** check_loop_and_init(lua_State *L, int loop_i) {
-    struct ev_loop** loop_r = check_loop(L, loop_i);
+    struct ev_loop** loop_r;
+
+    watcher_bound_loop(L, loop_i);
+    loop_r = check_loop(L, loop_i);
     if ( UNINITIALIZED_DEFAULT_LOOP == *loop_r ) {
-        *loop_r = ev_default_loop(EVFLAG_AUTO);
+        /* The libev default loop belongs to the main thread: */
+        *loop_r = thread_is_spawned(L) ?
+            ev_loop_new(EVFLAG_AUTO) : ev_default_loop(EVFLAG_AUTO);
         if ( NULL == *loop_r ) {
             luaL_error(L,
                        "libev init failed, perhaps LIBEV_FLAGS environment variable "
@@ -97,6 +184,11 @@ static int loop_new(lua_State *L) {
         lua_tointeger(L, 1) : EVFLAG_AUTO;
 
     *loop_r = ev_loop_new(flags);
+    if ( NULL == *loop_r ) {
+        /* The __gc of the loop object ignores the uninitialized token: */
+        *loop_r = UNINITIALIZED_DEFAULT_LOOP;
+        return luaL_error(L, "libev init failed, backend 0x%x not available?", flags);
+    }
 
     register_obj(L, -1, *loop_r);
 
@@ -104,24 +196,78 @@ static int loop_new(lua_State *L) {
 }
 
 /**
- * Delete a loop instance.  Default event loop is ignored.
+ * Delete a loop instance.  Default event loop is ignored.  Watchers
+ * still registered with the loop are released so that they can be
+ * collected along with it.
  */
 static int loop_delete(lua_State *L) {
-    struct ev_loop* loop = *check_loop(L, 1);
+    evlua_loop*     lp   = check_evlua_loop(L, 1);
+    struct ev_loop* loop = lp->loop;
+
+    while ( NULL != lp->active ) {
+        evlua_watcher* ext = lp->active;
+
+        lp->active = ext->next;
+        lua_rawgeti(L, LUA_REGISTRYINDEX, ext->ref);
+        if ( OBJ_THREAD == obj_type(L, -1) ) {
+            if ( ext->is_daemon ) ev_ref(loop);
+            thread_forget_loop(L, -1, loop);
+        }
+        lua_pop(L, 1);
+        luaL_unref(L, LUA_REGISTRYINDEX, ext->ref);
+        ext->ref       = LUA_NOREF;
+        ext->loop      = NULL;
+        ext->is_daemon = 0;
+        ext->prev      = NULL;
+        ext->next      = NULL;
+    }
+    lp->watchers = 0;
 
-    if ( UNINITIALIZED_DEFAULT_LOOP == loop ||
-         ev_is_default_loop(loop)           ) return 0;
+    free(lp->read_buf);
+    lp->read_buf      = NULL;
+    lp->read_buf_size = 0;
 
+    lua_rawgeti(L, LUA_REGISTRYINDEX, lp->refs);
+    luaL_unref(L, -1, lp->ref);
+    lua_pop(L, 1);
+    lp->ref = LUA_NOREF;
+
+    if ( UNINITIALIZED_DEFAULT_LOOP == loop ) return 0;
+
+    if ( ev_is_active(&lp->adapt) ) {
+        /* The prepare lives in this userdata which is going away: */
+        ev_ref(loop);
+        ev_prepare_stop(loop, &lp->adapt);
+    }
+    if ( ev_is_active(&lp->probe) ) {
+        ev_ref(loop);
+        ev_timer_stop(loop, &lp->probe);
+    }
+    work_drain(lp);
+
+    if ( ev_is_default_loop(loop) ) {
+        /* The default loop outlives this lua_State, so unhook it: */
+        ev_set_invoke_pending_cb(loop, ev_invoke_pending);
+        ev_set_loop_release_cb(loop, NULL, NULL);
+        return 0;
+    }
+
+    async_pool_forget_loop(loop);
     ev_loop_destroy(loop);
     return 0;
 }
 
 /**
  * Must be called aftert start()ing a watcher.  This is necessary so
- * that the watcher is not prematurely garbage collected, and if the
+ * that the watcher is not prematurely garbage collected, so that
+ * watcher_cb() can find the watcher and loop objects, and if the
  * watcher is "marked as a daemon", then ev_unref() is called so that
  * this watcher does not prevent the event loop from terminating.
  *
+ * The watcher is linked into the active list of the loop, which holds
+ * no lua references: the registry ref taken here keeps it alive, so
+ * registering and unregistering never touches a lua table.
+ *
  * is_daemon may be -1 to specify that if this watcher is already
  * registered in the event loop, then use the current is_daemon value,
  * otherwise set is_daemon to false.
@@ -129,46 +275,40 @@ static int loop_delete(lua_State *L) {
  * [-0, +0, m]
  */
 static void loop_start_watcher(lua_State* L, int loop_i, int watcher_i, int is_daemon) {
-    int current_is_daemon = -1;
+    evlua_watcher* ext;
+    evlua_loop*    lp;
 
     loop_i    = lua_absindex(L, loop_i);
     watcher_i = lua_absindex(L, watcher_i);
 
-    /* Check that watcher isn't already registered: */
-    lua_getuservalue(L, loop_i);
-    lua_pushvalue(L,   watcher_i);
-    lua_rawget(L,      -2);
+    ext = WATCHER_EXT(lua_touserdata(L, watcher_i));
+    lp  = (evlua_loop*)lua_touserdata(L, loop_i);
 
-    if ( ! lua_isnil(L, -1) ) {
-        current_is_daemon = lua_toboolean(L, -1);
+    if ( NULL == ext->loop ) {
+        /* Hold direct references for watcher_cb(): */
+        lua_pushvalue(L, watcher_i);
+        ext->ref       = luaL_ref(L, LUA_REGISTRYINDEX);
+        ext->loop      = lp;
+        ext->is_daemon = 0;
+
+        ext->prev = NULL;
+        ext->next = lp->active;
+        if ( NULL != lp->active ) lp->active->prev = ext;
+        lp->active = ext;
+        lp->watchers++;
     }
-    lua_pop(L, 1);
 
-    if ( is_daemon == -1 ) {
-        /* Set is_daemon properly for -1 case. */
-        if ( current_is_daemon == -1 )
-            is_daemon = 0;
-        else
-            is_daemon = current_is_daemon;
-    }
-
-    /* Currently not initialized, or daemon status change? */
-    if ( -1 == current_is_daemon ||
-         current_is_daemon ^ is_daemon )
-    {
-        lua_pushvalue(L,   watcher_i);
-        lua_pushboolean(L, is_daemon);
-        lua_rawset(L,      -3);
-        lua_pop(L,         1);
-
-        if ( ! is_daemon && -1 == current_is_daemon ) {
-            /* Do nothing, we are initializing a non-daemon */
-        } else if ( is_daemon ) {
+    if ( -1 == is_daemon ) is_daemon = ext->is_daemon;
+
+    /* Daemon status change? */
+    if ( ext->is_daemon != is_daemon ) {
+        ext->is_daemon = is_daemon;
+        if ( is_daemon ) {
             /* unref() so that we are a "daemon" */
-            ev_unref(*check_loop_and_init(L, loop_i));
+            ev_unref(ext->loop->loop);
         } else {
             /* ref() so that we are no longer a "daemon" */
-            ev_ref(*check_loop_and_init(L, loop_i));
+            ev_ref(ext->loop->loop);
         }
     }
 }
@@ -177,37 +317,43 @@ static void loop_start_watcher(lua_State* L, int loop_i, int watcher_i, int is_d
  * Must be called aftert stop()ing a watcher, or after a watcher is
  * automatically stopped (such as a non-repeating timer expiring).
  * This is necessary so that the watcher is not prematurely garbage
- * collected, and if the watcher is "marked as a daemon", then
- * ev_ref() is called in order to "undo" what was done in
- * loop_add_watcher().
+ * collected, to drop the references taken for watcher_cb(), and if
+ * the watcher is "marked as a daemon", then ev_ref() is called in
+ * order to "undo" what was done in loop_start_watcher().  The watcher
+ * is unlinked from the loop it was registered with.
  *
  * [-0, +0, m]
  */
-static void loop_stop_watcher(lua_State* L, int loop_i, int watcher_i) {
-    loop_i    = lua_absindex(L, loop_i);
-    watcher_i = lua_absindex(L, watcher_i);
+static void loop_stop_watcher(lua_State* L, int watcher_i) {
+    evlua_watcher* ext = WATCHER_EXT(lua_touserdata(L, watcher_i));
+    evlua_loop*    lp  = ext->loop;
 
-    lua_getuservalue(L, loop_i);
-    lua_pushvalue(L,   watcher_i);
-    lua_rawget(L,      -2);
+    if ( NULL == lp ) return;
 
-    if ( lua_toboolean(L, -1) ) ev_ref(*check_loop_and_init(L, loop_i));
-    lua_pop(L, 1);
+    if ( ext->is_daemon ) ev_ref(lp->loop);
+
+    if ( NULL != ext->prev ) {
+        ext->prev->next = ext->next;
+    } else {
+        lp->active = ext->next;
+    }
+    if ( NULL != ext->next ) ext->next->prev = ext->prev;
 
-    lua_pushvalue(L,   watcher_i);
-    lua_pushnil(L);
-    lua_rawset(L,      -3);
-    lua_pop(L,         1);
+    luaL_unref(L, LUA_REGISTRYINDEX, ext->ref);
+    ext->ref  = LUA_NOREF;
+    ext->loop = NULL;
+    lp->watchers--;
 }
 
 /**
- * Check if this is the default event loop.
+ * Check if this is the default event loop.  The ev.Loop.default of a
+ * spawned thread is not, see check_loop_and_init().
  */
 static int loop_is_default(lua_State *L) {
     struct ev_loop* loop = *check_loop(L, 1);
     lua_pushboolean(L,
-                    UNINITIALIZED_DEFAULT_LOOP == loop ||
-                    ev_is_default_loop(loop)           );
+                    UNINITIALIZED_DEFAULT_LOOP == loop ?
+                    ! thread_is_spawned(L) : ev_is_default_loop(loop));
     return 1;
 }
 
@@ -252,18 +398,124 @@ static int loop_update_now(lua_State *L) {
     return 1;
 }
 
+/**
+ * Run the event loop with the given ev_loop() flags so that callbacks
+ * are invoked in L.  Returns the number of callbacks invoked.  While
+ * it runs, the loop is loop_running of this thread.
+ */
+static unsigned long loop_run_flags(lua_State *L, evlua_loop* lp, int flags) {
+    unsigned long callbacks    = lp->callbacks;
+    void*         old_userdata = ev_userdata(lp->loop);
+    evlua_loop*   old_running  = loop_running;
+
+    ev_set_userdata(lp->loop, L);
+    loop_running = lp;
+    ev_loop(lp->loop, flags);
+    loop_running = old_running;
+    ev_set_userdata(lp->loop, old_userdata);
+
+    return lp->callbacks - callbacks;
+}
+
 /**
  * Actually do the event loop.
  */
 static int loop_loop(lua_State *L) {
-    struct ev_loop *loop = *check_loop_and_init(L, 1);
-    void *old_userdata = ev_userdata(loop);
-    ev_set_userdata(loop, L);
-    ev_loop(loop, 0);
-    ev_set_userdata(loop, old_userdata);
+    loop_run_flags(L, (evlua_loop*)check_loop_and_init(L, 1), 0);
     return 0;
 }
 
+/**
+ * Run the event loop, optionally only for a single iteration so the
+ * loop can be driven from a foreign scheduler.  Returns the number of
+ * watcher callbacks that were invoked.
+ *
+ * Usage:
+ *   count = loop:run([{ nowait = bool, once = bool }])
+ *
+ * nowait - poll for new events without blocking, invoke the pending
+ *          callbacks and return.
+ * once   - block until at least one event is available (or the next
+ *          timer expires), invoke the pending callbacks and return.
+ *
+ * [-0, +1, e]
+ */
+static int loop_run(lua_State *L) {
+    evlua_loop* lp    = (evlua_loop*)check_loop_and_init(L, 1);
+    int         flags = 0;
+
+    if ( ! lua_isnoneornil(L, 2) ) {
+        luaL_checktype(L, 2, LUA_TTABLE);
+
+        lua_getfield(L, 2, "nowait");
+        if ( lua_toboolean(L, -1) ) flags |= EVLOOP_NONBLOCK;
+        lua_getfield(L, 2, "once");
+        if ( lua_toboolean(L, -1) ) flags |= EVLOOP_ONESHOT;
+        lua_pop(L, 2);
+    }
+
+    lua_pushinteger(L, (lua_Integer)loop_run_flags(L, lp, flags));
+    return 1;
+}
+
+/**
+ * Returns the number of seconds until the loop needs to run again to
+ * service a timer or periodic, 0 if callbacks are pending or idle
+ * watchers are active, or nil if only io (or similar) watchers are
+ * registered.  The lag probe of loop:lag_probe() counts as a timer, the
+ * adaptive collect prepare never wakes the loop up by itself.  The
+ * active watchers are scanned (a registry lookup each), so the cost is
+ * linear in the number of registered watchers: call it once per
+ * iteration at most.
+ *
+ * Usage:
+ *   seconds = loop:next_timeout()
+ *
+ * [-0, +1, e]
+ */
+static int loop_next_timeout(lua_State *L) {
+    struct ev_loop* loop    = *check_loop_and_init(L, 1);
+    evlua_loop*     lp      = (evlua_loop*)lua_touserdata(L, 1);
+    ev_tstamp       timeout = -1;
+    evlua_watcher*  ext;
+
+    if ( ev_is_active(&lp->probe) ) {
+        timeout = ev_is_pending(&lp->probe) ? 0 : ev_timer_remaining(loop, &lp->probe);
+        if ( timeout < 0 ) timeout = 0;
+    }
+
+    for ( ext = lp->active; NULL != ext; ext = ext->next ) {
+        ev_watcher* w;
+        ev_tstamp   remaining;
+
+        lua_rawgeti(L, LUA_REGISTRYINDEX, ext->ref);
+        w = (ev_watcher*)lua_touserdata(L, -1);
+        lua_pop(L, 1);
+
+        if ( ev_is_pending(w) || w->cb == (void*)&idle_cb ) {
+            remaining = 0;
+        } else if ( w->cb == (void*)&timer_cb       ||
+                    w->cb == (void*)&timer_wheel_cb ||
+                    w->cb == (void*)&timeout_cb ) {
+            remaining = ev_timer_remaining(loop, (ev_timer*)w);
+        } else if ( w->cb == (void*)&periodic_cb ) {
+            remaining = ev_periodic_at((ev_periodic*)w) - ev_now(loop);
+        } else {
+            continue;
+        }
+
+        if ( remaining < 0 ) remaining = 0;
+        if ( timeout < 0 || remaining < timeout ) timeout = remaining;
+    }
+
+    if ( timeout < 0 ) {
+        lua_pushnil(L);
+    } else {
+        lua_pushnumber(L, timeout);
+    }
+    return 1;
+}
+
 /**
  * "Quit" out of the event loop.
  */
@@ -273,13 +525,38 @@ static int loop_unloop(lua_State *L) {
 }
 
 /**
- * Determine which backend is implementing the event loop.
+ * Determine which backend is implementing the event loop.  Returns the
+ * EVBACKEND_* value and its name.
  *
- * [-0, +1, m]
+ * [-0, +2, m]
  */
 static int loop_backend(lua_State *L) {
-    lua_pushinteger(L, ev_backend(*check_loop_and_init(L, 1)));
-    return 1;
+    unsigned int backend = ev_backend(*check_loop_and_init(L, 1));
+
+    lua_pushinteger(L, backend);
+    lua_pushstring(L, loop_backend_name(backend));
+    return 2;
+}
+
+/**
+ * The name of a single EVBACKEND_* value.
+ */
+static const char* loop_backend_name(unsigned int backend) {
+    switch ( backend ) {
+    case EVBACKEND_SELECT:   return "select";
+    case EVBACKEND_POLL:     return "poll";
+    case EVBACKEND_EPOLL:    return "epoll";
+    case EVBACKEND_KQUEUE:   return "kqueue";
+    case EVBACKEND_DEVPOLL:  return "devpoll";
+    case EVBACKEND_PORT:     return "port";
+#if EV_VERSION_AT_LEAST(4, 27)
+    case EVBACKEND_LINUXAIO: return "linuxaio";
+#endif
+#if EV_VERSION_AT_LEAST(4, 31)
+    case EVBACKEND_IOURING:  return "iouring";
+#endif
+    }
+    return "unknown";
 }
 
 /**
@@ -300,3 +577,619 @@ static int loop_fork(lua_State *L) {
 
     return 0;
 }
+
+/**
+ * Get/set the io collect interval, the minimum time libev waits
+ * between polls so that more io events can be handled per
+ * iteration.  If passed a new_interval, then the old interval is
+ * returned.  Setting an interval disables the adaptive mode.
+ *
+ * Usage:
+ *   old_interval = loop:io_collect_interval([new_interval])
+ *
+ * [-0, +1, e]
+ */
+static int loop_io_collect_interval(lua_State *L) {
+    evlua_loop* lp  = (evlua_loop*)check_loop_and_init(L, 1);
+    ev_tstamp   old = lp->io_collect;
+
+    if ( lua_gettop(L) > 1 ) {
+        ev_tstamp interval = luaL_checknumber(L, 2);
+        if ( interval < 0.0 )
+            luaL_argerror(L, 2, "interval must be greater than or equal to 0");
+
+        if ( ev_is_active(&lp->adapt) ) {
+            ev_ref(lp->loop);
+            ev_prepare_stop(lp->loop, &lp->adapt);
+        }
+        lp->io_collect = interval;
+        ev_set_io_collect_interval(lp->loop, interval);
+    }
+    lua_pushnumber(L, old);
+    return 1;
+}
+
+/**
+ * Get/set the timeout collect interval, the minimum time libev waits
+ * between polls so that more timers can be expired per iteration.
+ * If passed a new_interval, then the old interval is returned.
+ *
+ * Usage:
+ *   old_interval = loop:timeout_collect_interval([new_interval])
+ *
+ * [-0, +1, e]
+ */
+static int loop_timeout_collect_interval(lua_State *L) {
+    evlua_loop* lp  = (evlua_loop*)check_loop_and_init(L, 1);
+    ev_tstamp   old = lp->timeout_collect;
+
+    if ( lua_gettop(L) > 1 ) {
+        ev_tstamp interval = luaL_checknumber(L, 2);
+        if ( interval < 0.0 )
+            luaL_argerror(L, 2, "interval must be greater than or equal to 0");
+
+        lp->timeout_collect = interval;
+        ev_set_timeout_collect_interval(lp->loop, interval);
+    }
+    lua_pushnumber(L, old);
+    return 1;
+}
+
+/**
+ * Let the loop pick the io collect interval by itself.  Before the
+ * loop blocks, the number of callbacks invoked in the last iteration
+ * is compared against busy and idle.  At or above busy the interval
+ * is doubled (starting at max_interval / 16) up to max_interval, so
+ * each poll returns a larger batch of events.  Below idle it drops
+ * back to 0 so light traffic is served without added latency.
+ * Passing 0 for max_interval disables the adaptive mode and resets
+ * the interval to 0.
+ *
+ * Usage:
+ *   loop:adaptive_collect(max_interval [, busy [, idle]])
+ *
+ * busy defaults to 64 and idle to 8 callbacks per iteration.
+ *
+ * [-0, +0, e]
+ */
+static int loop_adaptive_collect(lua_State *L) {
+    evlua_loop* lp   = (evlua_loop*)check_loop_and_init(L, 1);
+    ev_tstamp   max  = luaL_checknumber(L, 2);
+    lua_Integer busy = luaL_optinteger(L, 3, 64);
+    lua_Integer idle = luaL_optinteger(L, 4, 8);
+
+    if ( max < 0.0 )
+        luaL_argerror(L, 2, "max_interval must be greater than or equal to 0");
+    if ( busy < 1 )
+        luaL_argerror(L, 3, "busy must be greater than 0");
+    if ( idle < 0 || idle > busy )
+        luaL_argerror(L, 4, "idle must be between 0 and busy");
+
+    lp->adapt_max       = max;
+    lp->adapt_busy      = (unsigned int)busy;
+    lp->adapt_idle      = (unsigned int)idle;
+    lp->adapt_callbacks = lp->callbacks;
+    lp->io_collect      = 0;
+    ev_set_io_collect_interval(lp->loop, 0);
+
+    if ( max > 0.0 && ! ev_is_active(&lp->adapt) ) {
+        ev_prepare_start(lp->loop, &lp->adapt);
+        /* Internal helper, must not keep the loop alive: */
+        ev_unref(lp->loop);
+    } else if ( max <= 0.0 && ev_is_active(&lp->adapt) ) {
+        ev_ref(lp->loop);
+        ev_prepare_stop(lp->loop, &lp->adapt);
+    }
+    return 0;
+}
+
+/**
+ * Runs right before the loop blocks to adjust the io collect interval,
+ * see loop_adaptive_collect().
+ */
+static void loop_adapt_cb(struct ev_loop* loop, ev_prepare* prepare, int revents) {
+    evlua_loop*   lp       = (evlua_loop*)
+        ((char*)prepare - offsetof(evlua_loop, adapt));
+    unsigned long count    = lp->callbacks - lp->adapt_callbacks;
+    ev_tstamp     interval = lp->io_collect;
+
+    lp->adapt_callbacks = lp->callbacks;
+
+    if ( count >= lp->adapt_busy ) {
+        interval = interval > 0 ? interval * 2 : lp->adapt_max / 16;
+        if ( interval > lp->adapt_max ) interval = lp->adapt_max;
+    } else if ( count < lp->adapt_idle ) {
+        interval = 0;
+    }
+
+    if ( interval != lp->io_collect ) {
+        lp->io_collect = interval;
+        ev_set_io_collect_interval(loop, interval);
+    }
+}
+
+/**
+ * Hooks the statistics collection into a loop, on the first call of
+ * loop:stats(), so loops nobody asks about run without the hooks.
+ */
+static void loop_stats_init(evlua_loop* lp) {
+    lp->stats = 1;
+    loop_stats_reset(lp);
+    ev_set_invoke_pending_cb(lp->loop, &loop_invoke_pending_cb);
+    ev_set_loop_release_cb(lp->loop, &loop_release_cb, &loop_acquire_cb);
+}
+
+static void loop_stats_reset(evlua_loop* lp) {
+    lp->stats_since       = ev_time();
+    lp->stats_iteration   = ev_iteration(lp->loop);
+    lp->stats_callbacks   = lp->callbacks;
+    lp->stats_invokes     = 0;
+    lp->stats_pending     = 0;
+    lp->stats_pending_max = 0;
+    lp->stats_blocked     = 0;
+    lp->stats_running     = 0;
+    lp->stats_released    = 0;
+}
+
+/**
+ * Returns the loop object of an ev_loop run by loop_run_flags() in
+ * this thread.  The libev hooks only get the ev_loop, and its
+ * userdata is taken by the lua_State.  Loops run some other way (such
+ * as embedded loops) are not counted.
+ *
+ * [-0, +0, -]
+ */
+static evlua_loop* loop_hooked(struct ev_loop* loop) {
+    evlua_loop* lp = loop_running;
+
+    return NULL != lp && lp->loop == loop ? lp : NULL;
+}
+
+/**
+ * Replaces ev_invoke_pending() to count and time the invocation of
+ * pending watchers.
+ */
+static void loop_invoke_pending_cb(struct ev_loop* loop) {
+    unsigned int pending = ev_pending_count(loop);
+    evlua_loop*  lp;
+    ev_tstamp    start;
+
+    if ( 0 == pending || NULL == (lp = loop_hooked(loop)) ) {
+        ev_invoke_pending(loop);
+        return;
+    }
+
+    lp->stats_invokes++;
+    lp->stats_pending += pending;
+    if ( pending > lp->stats_pending_max ) lp->stats_pending_max = pending;
+
+    start = ev_time();
+    ev_invoke_pending(loop);
+    lp->stats_running += ev_time() - start;
+}
+
+/**
+ * Called right before the loop blocks in the backend...
+ */
+static void loop_release_cb(struct ev_loop* loop) {
+    evlua_loop* lp = loop_hooked(loop);
+
+    if ( NULL != lp ) lp->stats_released = ev_time();
+}
+
+/**
+ * ...and right after it returns from it.
+ */
+static void loop_acquire_cb(struct ev_loop* loop) {
+    evlua_loop* lp = loop_hooked(loop);
+
+    if ( NULL != lp && lp->stats_released > 0 ) {
+        lp->stats_blocked += ev_time() - lp->stats_released;
+        lp->stats_released = 0;
+    }
+}
+
+/**
+ * Returns the runtime statistics collected since the first call (which
+ * installs the hooks, see loop_stats_init()) or the stats were last
+ * reset, and optionally resets them.  The fields of the returned table
+ * are:
+ *
+ *   elapsed     - seconds since the last reset
+ *   iterations  - loop iterations
+ *   callbacks   - lua callbacks invoked
+ *   blocked     - seconds spent waiting for events in the backend
+ *   running     - seconds spent invoking watchers
+ *   invokes     - number of times pending watchers were invoked
+ *   pending_avg - average number of pending watchers per invoke
+ *   pending_max - highest number of pending watchers in one invoke
+ *
+ * Usage:
+ *   stats = loop:stats([reset])
+ *
+ * [-0, +1, e]
+ */
+static int loop_stats(lua_State *L) {
+    evlua_loop* lp = (evlua_loop*)check_loop_and_init(L, 1);
+
+    if ( ! lp->stats ) loop_stats_init(lp);
+
+    lua_createtable(L, 0, 8);
+    lua_pushnumber(L, ev_time() - lp->stats_since);
+    lua_setfield(L, -2, "elapsed");
+    lua_pushnumber(L, (lua_Number)(ev_iteration(lp->loop) - lp->stats_iteration));
+    lua_setfield(L, -2, "iterations");
+    lua_pushnumber(L, (lua_Number)(lp->callbacks - lp->stats_callbacks));
+    lua_setfield(L, -2, "callbacks");
+    lua_pushnumber(L, lp->stats_blocked);
+    lua_setfield(L, -2, "blocked");
+    lua_pushnumber(L, lp->stats_running);
+    lua_setfield(L, -2, "running");
+    lua_pushnumber(L, (lua_Number)lp->stats_invokes);
+    lua_setfield(L, -2, "invokes");
+    lua_pushnumber(L, lp->stats_invokes ?
+                   (lua_Number)lp->stats_pending / lp->stats_invokes : 0);
+    lua_setfield(L, -2, "pending_avg");
+    lua_pushinteger(L, lp->stats_pending_max);
+    lua_setfield(L, -2, "pending_max");
+
+    if ( lua_toboolean(L, 2) ) loop_stats_reset(lp);
+
+    return 1;
+}
+
+/**
+ * Returns true if the callbacks of watchers are profiled, and
+ * optionally turns that on or off.  The profile of each watcher is
+ * available through watcher:stats() and loop:top_watchers().
+ *
+ * Usage:
+ *   old_enabled = loop:profile([enabled])
+ *
+ * [-0, +1, e]
+ */
+static int loop_profile(lua_State *L) {
+    evlua_loop* lp  = check_evlua_loop(L, 1);
+    int         old = lp->profile;
+
+    if ( ! lua_isnoneornil(L, 2) ) lp->profile = lua_toboolean(L, 2);
+
+    lua_pushboolean(L, old);
+    return 1;
+}
+
+/**
+ * Orders by descending total time for qsort().
+ */
+static int loop_rank_cmp(const void* a, const void* b) {
+    ev_tstamp ta = ((const evlua_watcher_rank*)a)->stats->total;
+    ev_tstamp tb = ((const evlua_watcher_rank*)b)->stats->total;
+
+    return ta < tb ? 1 : ta > tb ? -1 : 0;
+}
+
+/**
+ * Returns an array with the profile of the n (default 10) watchers
+ * registered with this loop that spent the most time in their
+ * callback, slowest first.  Each element is a table like the one
+ * returned by watcher:stats() with an additional "watcher" field.
+ *
+ * Usage:
+ *   top = loop:top_watchers([n])
+ *
+ * [-0, +1, e]
+ */
+static int loop_top_watchers(lua_State *L) {
+    lua_Integer         n  = luaL_optinteger(L, 2, 10);
+    evlua_loop*         lp = check_evlua_loop(L, 1);
+    int                 m  = 0;
+    int                 i;
+    evlua_watcher*      ext;
+    evlua_watcher_rank* ranks;
+
+    lua_settop(L, 1);
+    ranks = (evlua_watcher_rank*)
+        lua_newuserdata(L, (lp->watchers ? lp->watchers : 1) * sizeof(evlua_watcher_rank));
+    lua_createtable(L, lp->watchers, 0);
+
+    /* STACK: <loop>, <ranks>, <watcher by index> */
+    for ( ext = lp->active; NULL != ext; ext = ext->next ) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, ext->ref);
+        watcher_push_fenv(L, -1, 0);
+        if ( lua_istable(L, -1) ) {
+            lua_rawgeti(L, -1, WATCHER_STATS);
+            if ( NULL != lua_touserdata(L, -1) ) {
+                ranks[m].stats = (evlua_watcher_stats*)lua_touserdata(L, -1);
+                ranks[m].i     = m + 1;
+                m++;
+                lua_pushvalue(L, -3);
+                lua_rawseti(L, 3, m);
+            }
+            lua_pop(L, 1);
+        }
+        lua_pop(L, 2);
+    }
+    qsort(ranks, m, sizeof(evlua_watcher_rank), &loop_rank_cmp);
+
+    if ( n > m ) n = m;
+    lua_createtable(L, (int)(n > 0 ? n : 0), 0);
+    for ( i = 0; i < n; i++ ) {
+        watcher_push_stats(L, ranks[i].stats);
+        lua_rawgeti(L, 3, ranks[i].i);
+        lua_setfield(L, -2, "watcher");
+        lua_rawseti(L, -2, i + 1);
+    }
+
+    return 1;
+}
+
+/**
+ * Adds a latency to a histogram.  Negative latencies are counted as
+ * 0.
+ */
+static void latency_record(evlua_latency* hist, ev_tstamp seconds) {
+    uint64_t usec;
+    int      bucket;
+    int      bits;
+
+    if ( seconds < 0 ) seconds = 0;
+
+    hist->count++;
+    hist->sum += seconds;
+    if ( seconds > hist->max ) hist->max = seconds;
+
+    usec = seconds * 1e6 < (double)((uint64_t)1 << LATENCY_MAX_BITS) ?
+        (uint64_t)(seconds * 1e6) : ((uint64_t)1 << LATENCY_MAX_BITS) - 1;
+    if ( usec < (1 << LATENCY_SUB_BITS) ) {
+        bucket = (int)usec;
+    } else {
+        for ( bits = LATENCY_SUB_BITS; usec >> (bits + 1); bits++ );
+        bucket = ((bits - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS) +
+            (int)((usec >> (bits - LATENCY_SUB_BITS)) & ((1 << LATENCY_SUB_BITS) - 1));
+    }
+    hist->buckets[bucket]++;
+}
+
+/**
+ * The value in seconds reported for a bucket: the middle of the range
+ * it counts.
+ */
+static ev_tstamp latency_value(int bucket) {
+    int      group = bucket >> LATENCY_SUB_BITS;
+    int      bits;
+    uint64_t low;
+
+    if ( 0 == group ) return bucket / 1e6;
+
+    bits = group + LATENCY_SUB_BITS - 1;
+    low  = ((uint64_t)1 << bits) +
+        ((uint64_t)(bucket & ((1 << LATENCY_SUB_BITS) - 1)) << (bits - LATENCY_SUB_BITS));
+
+    return (low + ((uint64_t)1 << (bits - LATENCY_SUB_BITS)) / 2.0) / 1e6;
+}
+
+/**
+ * Pushes a table with the count, mean, max and the p50, p90, p99 and
+ * p999 percentiles (in seconds) of a histogram.
+ *
+ * [-0, +1, m]
+ */
+static void latency_push(lua_State *L, evlua_latency* hist) {
+    static const struct { const char* name; double q; } pcts[] = {
+        { "p50",  0.5 },
+        { "p90",  0.9 },
+        { "p99",  0.99 },
+        { "p999", 0.999 },
+    };
+    unsigned long seen   = 0;
+    int           bucket = 0;
+    int           i;
+
+    lua_createtable(L, 0, 7);
+    lua_pushnumber(L, (lua_Number)hist->count);
+    lua_setfield(L, -2, "count");
+    lua_pushnumber(L, hist->count ? hist->sum / hist->count : 0);
+    lua_setfield(L, -2, "mean");
+    lua_pushnumber(L, hist->max);
+    lua_setfield(L, -2, "max");
+
+    for ( i = 0; i < (int)(sizeof(pcts) / sizeof(pcts[0])); i++ ) {
+        unsigned long rank = (unsigned long)ceil(pcts[i].q * hist->count);
+        ev_tstamp     value;
+
+        while ( seen < rank && bucket < LATENCY_BUCKETS ) {
+            seen += hist->buckets[bucket++];
+        }
+        /* The max is exact, so don't report more than that: */
+        value = bucket ? latency_value(bucket - 1) : 0;
+        lua_pushnumber(L, value < hist->max ? value : hist->max);
+        lua_setfield(L, -2, pcts[i].name);
+    }
+}
+
+/**
+ * The lag probe fired: record how much later than due that happened.
+ */
+static void loop_probe_cb(struct ev_loop* loop, ev_timer* probe, int revents) {
+    evlua_loop* lp = (evlua_loop*)
+        ((char*)probe - offsetof(evlua_loop, probe));
+
+    latency_record(&lp->lag, ev_time() - lp->probe_due);
+    lp->probe_due = ev_now(loop) + ev_timer_remaining(loop, probe);
+}
+
+/**
+ * Returns the period of the lag probe (0 if there is none), and
+ * optionally sets a new period.  The probe is a timer on the C side,
+ * so it measures how late the loop gets to its timers without being
+ * perturbed by lua.  It does not keep the loop running.  A period of
+ * 0 turns the probe off.  Also starts recording timer lateness, see
+ * loop_latency().
+ *
+ * Usage:
+ *   old_period = loop:lag_probe([period])
+ *
+ * [-0, +1, e]
+ */
+static int loop_lag_probe(lua_State *L) {
+    evlua_loop* lp     = (evlua_loop*)check_loop_and_init(L, 1);
+    ev_tstamp   old    = lp->probe.repeat;
+    ev_tstamp   period;
+
+    lp->latency = 1;
+    if ( ! lua_isnoneornil(L, 2) ) {
+        period = luaL_checknumber(L, 2);
+        if ( period < 0.0 )
+            luaL_argerror(L, 2, "period must be greater than or equal to 0");
+
+        if ( ev_is_active(&lp->probe) ) {
+            ev_ref(lp->loop);
+            ev_timer_stop(lp->loop, &lp->probe);
+        }
+        ev_timer_set(&lp->probe, period, period);
+        if ( period > 0.0 ) {
+            ev_timer_start(lp->loop, &lp->probe);
+            /* Internal helper, must not keep the loop alive: */
+            ev_unref(lp->loop);
+            lp->probe_due = ev_now(lp->loop) + period;
+        }
+    }
+
+    lua_pushnumber(L, old);
+    return 1;
+}
+
+/**
+ * Returns the latency histograms of the loop: lag, recorded by the
+ * lag probe, and timer, the lateness of every ev.Timer callback
+ * compared to its deadline.  Optionally resets them.  Timer lateness
+ * is only recorded once this or loop_lag_probe() was called, so loops
+ * nobody measures don't pay for it on every timer.
+ *
+ * Usage:
+ *   latency = loop:latency([reset])
+ *
+ * [-0, +1, e]
+ */
+static int loop_latency(lua_State *L) {
+    evlua_loop* lp = check_evlua_loop(L, 1);
+
+    lp->latency = 1;
+    lua_createtable(L, 0, 2);
+    latency_push(L, &lp->lag);
+    lua_setfield(L, -2, "lag");
+    latency_push(L, &lp->timer_late);
+    lua_setfield(L, -2, "timer");
+
+    if ( lua_toboolean(L, 2) ) {
+        memset(&lp->lag, 0, sizeof(evlua_latency));
+        memset(&lp->timer_late, 0, sizeof(evlua_latency));
+    }
+
+    return 1;
+}
+
+/**
+ * Handles an error raised by a callback.  If the loop has an error
+ * handler it is called as on_error(loop, watcher, err), and may
+ * return "stop" to stop the watcher or "unloop" to make the loop
+ * return.  Without a handler the error is printed to stderr.
+ *
+ * [-3, +0, m]
+ */
+static void loop_callback_error(lua_State *L) {
+    int         err_i     = lua_gettop(L);
+    int         watcher_i = err_i - 1;
+    int         loop_i    = err_i - 2;
+    const char* action;
+
+    /* STACK: <loop>, <watcher or nil>, <err> */
+    lua_pushlightuserdata(L, &loop_error_registry);
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    if ( lua_istable(L, -1) ) {
+        lua_pushvalue(L, loop_i);
+        lua_rawget(L, -2);
+        lua_replace(L, -2);
+    }
+    if ( ! lua_isfunction(L, -1) ) {
+        fprintf(stderr, "CALLBACK FAILED: %s\n",
+                lua_isstring(L, err_i) ? lua_tostring(L, err_i) : luaL_typename(L, err_i));
+        lua_settop(L, loop_i - 1);
+        return;
+    }
+
+    lua_pushvalue(L, loop_i);
+    lua_pushvalue(L, watcher_i);
+    lua_pushvalue(L, err_i);
+    if ( lua_pcall(L, 3, 1, 0) ) {
+        fprintf(stderr, "ERROR HANDLER FAILED: %s\n",
+                lua_isstring(L, -1) ? lua_tostring(L, -1) : luaL_typename(L, -1));
+        lua_settop(L, loop_i - 1);
+        return;
+    }
+
+    action = lua_tostring(L, -1);
+    if ( NULL == action ) {
+        /* Handled */
+    } else if ( 0 == strcmp(action, "unloop") ) {
+        ev_unloop(((evlua_loop*)lua_touserdata(L, loop_i))->loop, EVUNLOOP_ALL);
+    } else if ( 0 == strcmp(action, "stop") && ! lua_isnil(L, watcher_i) ) {
+        lua_getfield(L, watcher_i, "stop");
+        lua_pushvalue(L, watcher_i);
+        lua_pushvalue(L, loop_i);
+        if ( lua_pcall(L, 2, 0, 0) ) {
+            fprintf(stderr, "ERROR HANDLER FAILED: %s\n",
+                    lua_isstring(L, -1) ? lua_tostring(L, -1) : luaL_typename(L, -1));
+        }
+    }
+    lua_settop(L, loop_i - 1);
+}
+
+/**
+ * Returns the error handler of the loop and optionally sets a new
+ * one (nil restores printing errors to stderr).  The handler is only
+ * looked up when a callback fails, so it costs nothing otherwise.
+ * The stack of the failed callback is gone by the time the handler
+ * runs; callbacks that need a traceback can use xpcall() themselves.
+ *
+ * Usage:
+ *   old_handler = loop:on_error([handler])
+ *
+ * handler(loop, watcher, err) - watcher is nil for ev.Work
+ *   callbacks.  May return "stop" to stop the watcher or "unloop"
+ *   to make the loop return.
+ *
+ * [-0, +1, e]
+ */
+static int loop_on_error(lua_State *L) {
+    int has_fn = lua_gettop(L) > 1;
+
+    check_evlua_loop(L, 1);
+    if ( has_fn && ! lua_isnil(L, 2) ) luaL_checktype(L, 2, LUA_TFUNCTION);
+    lua_settop(L, 2);
+
+    lua_pushlightuserdata(L, &loop_error_registry);
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    if ( ! lua_istable(L, -1) ) {
+        lua_pop(L, 1);
+        /* Weak keys, so the handlers don't keep their loops alive: */
+        lua_newtable(L);
+        lua_createtable(L,  0, 1);
+        lua_pushliteral(L,   "k");
+        lua_setfield(L,     -2, "__mode");
+        lua_setmetatable(L, -2);
+        lua_pushlightuserdata(L, &loop_error_registry);
+        lua_pushvalue(L, -2);
+        lua_rawset(L, LUA_REGISTRYINDEX);
+    }
+
+    /* STACK: <loop>, <handler>, <handlers> */
+    lua_pushvalue(L, 1);
+    lua_rawget(L, 3);
+    if ( has_fn ) {
+        lua_pushvalue(L, 1);
+        lua_pushvalue(L, 2);
+        lua_rawset(L, 3);
+    }
+    return 1;
+}
@@ -1,8 +1,24 @@
 #include <assert.h>
+#include <errno.h>
 #include <ev.h>
+#include <fcntl.h>
 #include <lauxlib.h>
+#include <limits.h>
 #include <lua.h>
+#include <lualib.h>
+#include <math.h>
+#include <netdb.h>
+#include <pthread.h>
 #include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "lua_ev.h"
 
@@ -18,9 +34,25 @@
 #include "async_lua_ev.c"
 #include "child_lua_ev.c"
 #include "stat_lua_ev.c"
+#include "periodic_lua_ev.c"
+#include "prepare_lua_ev.c"
+#include "check_lua_ev.c"
+#include "embed_lua_ev.c"
+#include "reader_lua_ev.c"
+#include "writer_lua_ev.c"
+#include "timer_wheel_lua_ev.c"
+#include "timeout_lua_ev.c"
+#include "thread_lua_ev.c"
+#include "work_lua_ev.c"
+#include "pool_lua_ev.c"
+#include "group_lua_ev.c"
+#include "co_lua_ev.c"
 
 static const luaL_Reg R[] = {
     {"version", version},
+    {"supported_backends", supported_backends},
+    {"recommended_backends", recommended_backends},
+    {"embeddable_backends", embeddable_backends},
     {"object_count", obj_count},
     {NULL, NULL},
 };
@@ -37,6 +69,7 @@ LUALIB_API int luaopen_ev(lua_State *L) {
            ev_version_minor() >= EV_VERSION_MINOR);
 
     create_obj_registry(L);
+    create_loop_refs(L);
 
 #if LUA_VERSION_NUM > 501
     luaL_newlib(L, R);
@@ -44,6 +77,8 @@ LUALIB_API int luaopen_ev(lua_State *L) {
     luaL_register(L, "ev", R);
 #endif
 
+    lua_pop(L, create_pool_mt(L));
+
     luaopen_ev_loop(L);
     lua_setfield(L, -2, "Loop");
 
@@ -68,6 +103,42 @@ LUALIB_API int luaopen_ev(lua_State *L) {
     luaopen_ev_stat(L);
     lua_setfield(L, -2, "Stat");
 
+    luaopen_ev_periodic(L);
+    lua_setfield(L, -2, "Periodic");
+
+    luaopen_ev_prepare(L);
+    lua_setfield(L, -2, "Prepare");
+
+    luaopen_ev_check(L);
+    lua_setfield(L, -2, "Check");
+
+    luaopen_ev_embed(L);
+    lua_setfield(L, -2, "Embed");
+
+    luaopen_ev_reader(L);
+    lua_setfield(L, -2, "Reader");
+
+    luaopen_ev_writer(L);
+    lua_setfield(L, -2, "Writer");
+
+    luaopen_ev_timer_wheel(L);
+    lua_setfield(L, -2, "TimerWheel");
+
+    luaopen_ev_timeout(L);
+    lua_setfield(L, -2, "Timeout");
+
+    luaopen_ev_thread(L);
+    lua_setfield(L, -2, "Thread");
+
+    luaopen_ev_work(L);
+    lua_setfield(L, -2, "Work");
+
+    luaopen_ev_group(L);
+    lua_setfield(L, -2, "Group");
+
+    luaopen_ev_co(L);
+    lua_setfield(L, -2, "co");
+
 #define EV_SETCONST(state, prefix, C) \
     lua_pushnumber(L, prefix ## C); \
     lua_setfield(L, -2, #C)
@@ -77,6 +148,10 @@ LUALIB_API int luaopen_ev(lua_State *L) {
     EV_SETCONST(L, EV_, ASYNC);
     EV_SETCONST(L, EV_, MINPRI);
     EV_SETCONST(L, EV_, MAXPRI);
+    EV_SETCONST(L, EV_, PERIODIC);
+    EV_SETCONST(L, EV_, PREPARE);
+    EV_SETCONST(L, EV_, CHECK);
+    EV_SETCONST(L, EV_, EMBED);
     EV_SETCONST(L, EV_, READ);
     EV_SETCONST(L, EV_, SIGNAL);
     EV_SETCONST(L, EV_, STAT);
@@ -121,6 +196,32 @@ LUALIB_API int luaopen_ev(lua_State *L) {
     EV_SETCONST(L, , SIGXCPU);
     EV_SETCONST(L, , SIGXFSZ);
 
+    /* For ev.Loop.new(flags), see loop:backend() for the names: */
+    EV_SETCONST(L, EV, BACKEND_SELECT);
+    EV_SETCONST(L, EV, BACKEND_POLL);
+    EV_SETCONST(L, EV, BACKEND_EPOLL);
+    EV_SETCONST(L, EV, BACKEND_KQUEUE);
+    EV_SETCONST(L, EV, BACKEND_DEVPOLL);
+    EV_SETCONST(L, EV, BACKEND_PORT);
+#if EV_VERSION_AT_LEAST(4, 27)
+    EV_SETCONST(L, EV, BACKEND_LINUXAIO);
+#endif
+#if EV_VERSION_AT_LEAST(4, 31)
+    EV_SETCONST(L, EV, BACKEND_IOURING);
+#endif
+    EV_SETCONST(L, EV, BACKEND_ALL);
+    EV_SETCONST(L, EV, BACKEND_MASK);
+
+    EV_SETCONST(L, EV, FLAG_AUTO);
+    EV_SETCONST(L, EV, FLAG_NOENV);
+    EV_SETCONST(L, EV, FLAG_FORKCHECK);
+    EV_SETCONST(L, EV, FLAG_NOINOTIFY);
+    EV_SETCONST(L, EV, FLAG_SIGNALFD);
+    EV_SETCONST(L, EV, FLAG_NOSIGMASK);
+#if EV_VERSION_AT_LEAST(4, 33)
+    EV_SETCONST(L, EV, FLAG_NOTIMERFD);
+#endif
+
 #undef EV_SETCONST
 
     return 1;
@@ -137,6 +238,38 @@ static int version(lua_State *L) {
     return 2;
 }
 
+/**
+ * Push the bitmask of backends compiled into the linked libev.
+ *
+ * [+1, -0, -]
+ */
+static int supported_backends(lua_State *L) {
+    lua_pushinteger(L, ev_supported_backends());
+    return 1;
+}
+
+/**
+ * Push the bitmask of backends libev recommends on this platform,
+ * this is what EVFLAG_AUTO picks from.
+ *
+ * [+1, -0, -]
+ */
+static int recommended_backends(lua_State *L) {
+    lua_pushinteger(L, ev_recommended_backends());
+    return 1;
+}
+
+/**
+ * Push the bitmask of backends whose loops may be embedded into
+ * another loop with ev.Embed.
+ *
+ * [+1, -0, -]
+ */
+static int embeddable_backends(lua_State *L) {
+    lua_pushinteger(L, ev_embeddable_backends());
+    return 1;
+}
+
 /**
  * Taken from lua.c out of the lua source distribution.  Use this
  * function when doing lua_pcall().
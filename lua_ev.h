@@ -25,6 +25,8 @@
 
 #define lua_getuservalue(L, i) lua_getfenv((L), (i))
 
+#define lua_rawlen(L, i) lua_objlen((L), (i))
+
 /* NOTE: this only works if nups == 0! */
 #define luaL_setfuncs(L, fns, nups) luaL_register((L), NULL, (fns))
 
@@ -41,6 +43,54 @@
 #define IDLE_MT    "ev{idle}"
 #define CHILD_MT   "ev{child}"
 #define STAT_MT    "ev{stat}"
+#define PERIODIC_MT "ev{periodic}"
+#define PREPARE_MT "ev{prepare}"
+#define CHECK_MT   "ev{check}"
+#define EMBED_MT   "ev{embed}"
+#define READER_MT  "ev{reader}"
+#define WRITER_MT  "ev{writer}"
+#define TIMER_WHEEL_MT "ev{timer_wheel}"
+#define TIMEOUT_MT "ev{timeout}"
+#define THREAD_MT  "ev{thread}"
+#define ASYNC_SENDER_MT "ev{async_sender}"
+#define POOL_MT    "ev{pool}"
+#define GROUP_MT   "ev{group}"
+#define WORK_MT    "ev{work}"
+
+/**
+ * Type tags.  obj_new() stores OBJ_TAG() of the object at the end of
+ * the userdata, so obj_check() validates an argument with a pointer
+ * compare instead of looking up metatables.  Mixing in the address
+ * of the object makes a foreign userdata with a matching tag
+ * practically impossible.  Watcher types have OBJ_WATCHER set.
+ */
+#define OBJ_LOOP          0x001
+#define OBJ_ASYNC_SENDER  0x002
+#define OBJ_POOL          0x003
+#define OBJ_GROUP         0x004
+#define OBJ_WATCHER       0x100
+#define OBJ_IO            0x101
+#define OBJ_ASYNC         0x102
+#define OBJ_TIMER         0x103
+#define OBJ_SIGNAL        0x104
+#define OBJ_IDLE          0x105
+#define OBJ_CHILD         0x106
+#define OBJ_STAT          0x107
+#define OBJ_PERIODIC      0x108
+#define OBJ_PREPARE       0x109
+#define OBJ_CHECK         0x10a
+#define OBJ_EMBED         0x10b
+#define OBJ_READER        0x10c
+#define OBJ_WRITER        0x10d
+#define OBJ_TIMER_WHEEL   0x10e
+#define OBJ_TIMEOUT       0x10f
+#define OBJ_THREAD        0x110
+
+#define OBJ_TAG_MAGIC     ((uintptr_t)0x65766c00u)
+#define OBJ_TAG(obj, type)                                       \
+    ((uintptr_t)(obj) ^ OBJ_TAG_MAGIC ^ (uintptr_t)(type))
+#define OBJ_TAG_OFFSET(size)                                     \
+    (((size) + sizeof(uintptr_t) - 1) & ~(sizeof(uintptr_t) - 1))
 
 /**
  * Special token to represent the uninitialized default loop.  This is
@@ -49,9 +99,21 @@
  */
 #define UNINITIALIZED_DEFAULT_LOOP (struct ev_loop*)1
 
+/**
+ * On lua 5.4 watchers are compact: the callback function is the first
+ * user value of the watcher, and the table holding the other WATCHER_*
+ * slots is the second one, only created when one of them is used (see
+ * watcher_push_fenv()).  Elsewhere all the slots are in the fenv.
+ */
+#if LUA_VERSION_NUM >= 504
+#define WATCHER_COMPACT 1
+#else
+#define WATCHER_COMPACT 0
+#endif
+
 /**
  * The location in the fenv of the watcher that contains the callback
- * function.
+ * function, see watcher_push_fn().
  */
 #define WATCHER_FN 1
 
@@ -61,7 +123,384 @@
 #define WATCHER_SHADOW 2
 
 /**
- * Various "check" functions simply call luaL_checkudata() and do the
+ * The location in the fenv of an embed watcher that references the
+ * embedded loop.
+ */
+#define WATCHER_EMBED_LOOP 3
+
+/**
+ * The locations in the fenv of a watcher that a coroutine waits on
+ * (see co_lua_ev.c) of that coroutine, and of the other watcher
+ * taking part in the same wait (or of the parked callback of an
+ * async watcher).
+ */
+#define WATCHER_CO      4
+#define WATCHER_CO_PEER 5
+
+/**
+ * The location in the fenv of a writer watcher that contains the
+ * table of strings waiting to be written.
+ */
+#define WATCHER_QUEUE 6
+
+/**
+ * The locations in the fenv of a timer wheel that contain the loop it
+ * is bound to, the userdata holding its nodes, the key -> node table
+ * and the node -> key table.
+ */
+#define WATCHER_WHEEL_LOOP  7
+#define WATCHER_WHEEL_NODES 8
+#define WATCHER_WHEEL_INDEX 9
+#define WATCHER_WHEEL_KEYS  10
+
+/**
+ * The location in the fenv of a watcher that contains its
+ * evlua_watcher_stats, created the first time the watcher is called
+ * by a loop with profiling enabled (see loop_profile()).
+ */
+#define WATCHER_STATS 11
+
+/**
+ * The location in the fenv of a watcher that contains the loop it is
+ * bound to, see watcher_bind().
+ */
+#define WATCHER_LOOP 12
+
+/**
+ * A log-linear histogram of latencies, see latency_record().  Values
+ * are counted in microseconds, exactly below 2^LATENCY_SUB_BITS and
+ * otherwise with 2^LATENCY_SUB_BITS buckets per power of two, up to
+ * 2^LATENCY_MAX_BITS (about 12 days).
+ */
+#define LATENCY_SUB_BITS 3
+#define LATENCY_MAX_BITS 40
+#define LATENCY_BUCKETS  ((LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS)
+
+typedef struct {
+    unsigned long count;
+    ev_tstamp     sum;  /* seconds */
+    ev_tstamp     max;
+    unsigned int  buckets[LATENCY_BUCKETS];
+} evlua_latency;
+
+struct evlua_work_req;
+
+struct evlua_watcher;
+
+/**
+ * The loop userdata.  The ev_loop pointer must remain the first
+ * member since check_loop() hands out a struct ev_loop** into it.
+ * ref is a weak reference that lets watcher_cb() push the loop
+ * without a hash lookup; registered watchers do not keep the loop
+ * alive, loop_delete() releases them instead.
+ */
+typedef struct {
+    struct ev_loop* loop;
+    int             refs;       /* registry ref to the weak loop table */
+    int             ref;        /* ref to the loop userdata in refs */
+    int             watchers;   /* number of registered watchers */
+    struct evlua_watcher* active;  /* list of the registered watchers */
+    unsigned long   callbacks;  /* number of watcher callbacks invoked */
+    char*           read_buf;   /* shared by the readers, see reader_cb() */
+    size_t          read_buf_size;
+
+    ev_tstamp       io_collect;       /* last io collect interval set */
+    ev_tstamp       timeout_collect;  /* last timeout collect interval set */
+
+    /* Adaptive io collect interval, see loop_adaptive_collect(): */
+    ev_prepare      adapt;
+    ev_tstamp       adapt_max;
+    unsigned int    adapt_busy;
+    unsigned int    adapt_idle;
+    unsigned long   adapt_callbacks;
+
+    /* Completions of ev.Work requests, see work_async_cb(): */
+    ev_async        work;
+    struct evlua_work_req* work_done;  /* lock-free stack, pushed by workers */
+    int             work_pending;      /* submitted but not yet delivered */
+    int             work_inflight;     /* still owned by a worker, work_lock */
+    int             work_ref;          /* registry ref to the loop while pending */
+
+    /* Runtime statistics, see loop_stats(): */
+    ev_tstamp       stats_since;       /* when the stats were last reset */
+    unsigned int    stats_iteration;   /* ev_iteration() at the last reset */
+    unsigned long   stats_callbacks;   /* callbacks at the last reset */
+    unsigned long   stats_invokes;     /* times pending watchers were invoked */
+    unsigned long   stats_pending;     /* sum of the pending counts */
+    unsigned int    stats_pending_max;
+    ev_tstamp       stats_blocked;     /* seconds spent in the backend */
+    ev_tstamp       stats_running;     /* seconds spent invoking watchers */
+    ev_tstamp       stats_released;    /* when the loop last entered the backend */
+    int             stats;             /* hooks installed by loop:stats()? */
+    int             profile;           /* record per-watcher stats? */
+
+    /* Latency histograms, see loop_latency(): */
+    ev_timer        probe;             /* lag probe, see loop_lag_probe() */
+    ev_tstamp       probe_due;
+    evlua_latency   lag;
+    evlua_latency   timer_late;
+    int             latency;           /* record timer_late, see timer_cb() */
+} evlua_loop;
+
+/**
+ * Per-watcher bookkeeping that lives in the same userdata block as
+ * the libev watcher, directly after it.  The ev_watcher data field
+ * points here so watcher_cb() can find the lua objects without any
+ * table lookups.  The fields are only set while the watcher is
+ * registered with a loop (see loop_start_watcher()), which links it
+ * into the active list of that loop.
+ */
+typedef struct evlua_watcher {
+    int                   ref;        /* registry ref to the watcher userdata */
+    int                   is_daemon;  /* ev_unref() was called for it */
+    evlua_loop*           loop;       /* the loop it was started in */
+    struct evlua_watcher* prev;
+    struct evlua_watcher* next;
+} evlua_watcher;
+
+/**
+ * Profile of a watcher's callback, see watcher:stats().
+ */
+typedef struct {
+    unsigned long calls;
+    unsigned long errors;
+    ev_tstamp     total;  /* seconds spent in the callback */
+    ev_tstamp     max;
+} evlua_watcher_stats;
+
+/**
+ * Sort entry of loop:top_watchers().
+ */
+typedef struct {
+    evlua_watcher_stats* stats;
+    int                  i;  /* index of the watcher in a scratch table */
+} evlua_watcher_rank;
+
+/**
+ * Round up so the evlua_watcher that follows a libev watcher struct
+ * is properly aligned.
+ */
+#define WATCHER_EXT_OFFSET(size)                                 \
+    (((size) + sizeof(void*) - 1) & ~(sizeof(void*) - 1))
+
+#define WATCHER_EXT(w)                                           \
+    ((evlua_watcher*)((ev_watcher*)(w))->data)
+
+/**
+ * An ev.Async.  The ev_async must be first (contrib/ev-async.lua also
+ * relies on that).  slot is the index + 1 of its entry in the pool of
+ * exported async watchers, 0 if it was never exported.
+ */
+typedef struct {
+    ev_async     async;
+    unsigned int slot;
+} evlua_async;
+
+/**
+ * An entry in the process wide pool of exported async watchers, see
+ * async_export().  refs counts the owning ev.Async plus every sender
+ * imported from it; the entry is reused once it drops to 0, with gen
+ * bumped so stale tokens are rejected.
+ */
+typedef struct {
+    struct ev_loop* loop;   /* NULL while the async is not started */
+    ev_async*       async;  /* NULL once the ev.Async was collected */
+    unsigned int    refs;
+    unsigned int    gen;
+} evlua_async_slot;
+
+/**
+ * A sender returned by ev.Async.import().
+ */
+typedef struct {
+    unsigned int slot;  /* index + 1 into the pool, 0 once collected */
+    unsigned int gen;
+} evlua_async_sender;
+
+/**
+ * A pool of released timer or io watchers, see pool_acquire().  The
+ * watchers are kept in the fenv of the pool.
+ */
+typedef struct {
+    int           type;     /* OBJ_TIMER or OBJ_IO */
+    int           max;      /* most watchers kept for reuse */
+    unsigned long created;  /* watchers created by acquire() */
+} evlua_pool;
+
+#define ASYNC_POOL_SIZE 4096
+
+/**
+ * An ev.Reader is an ev_io that reads on the C side, see
+ * reader_lua_ev.c.  The ev_io must be first.
+ */
+typedef struct {
+    ev_io       io;
+    size_t      budget;  /* max bytes read per callback */
+} evlua_reader;
+
+/**
+ * Default for the max bytes an ev.Reader reads per callback.
+ */
+#define READER_BUDGET 65536
+
+/**
+ * An ev.Writer queues strings in its fenv (see WATCHER_QUEUE) and
+ * flushes them with writev(), see writer_lua_ev.c.  The ev_io must be
+ * first.  The prepare flushes corked writers at the end of the loop
+ * iteration.  Sockets are written with sendmsg(), see writer_flush().
+ */
+typedef struct {
+    ev_io       io;
+    ev_prepare  flush;
+    int         head;    /* queue index of the next string to write */
+    int         tail;    /* queue index after the last string */
+    size_t      offset;  /* bytes of the head string already written */
+    size_t      queued;  /* total bytes waiting to be written */
+    size_t      high;    /* high water mark */
+    size_t      low;     /* low water mark */
+    int         corked;  /* defer writes to the end of the iteration */
+    int         above;   /* reached high water, waiting for low */
+    int         is_socket;  /* write with sendmsg() */
+} evlua_writer;
+
+/**
+ * Defaults for ev.Writer: the high water mark and the max number of
+ * strings passed to a single writev().
+ */
+#define WRITER_HIGH_WATER 65536
+#define WRITER_IOV        64
+
+/**
+ * Flags for the sendmsg() of an ev.Writer, where the platform has
+ * them.  Without MSG_NOSIGNAL, SO_NOSIGPIPE is set on the socket
+ * instead if available.
+ */
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#ifndef MSG_MORE
+#define MSG_MORE     0
+#endif
+
+/**
+ * A timeout in an ev.TimerWheel.  Nodes live in an array; the first
+ * slots + 1 of them are the heads of the circular per-slot lists
+ * (node 0 is unused so 0 can end the free list).
+ */
+typedef struct {
+    unsigned int next;
+    unsigned int prev;
+    unsigned int rounds;   /* full turns of the wheel left */
+    float        timeout;  /* seconds, for reset() */
+} evlua_timer_wheel_node;
+
+/**
+ * An ev.TimerWheel, see timer_wheel_lua_ev.c.  The ev_timer must be
+ * first.
+ */
+typedef struct {
+    ev_timer                timer;
+    struct ev_loop*         loop;
+    evlua_timer_wheel_node* nodes;  /* kept alive by the fenv */
+    ev_tstamp               tick;
+    unsigned long           now;    /* ticks processed */
+    unsigned int            slots;
+    unsigned int            size;   /* nodes allocated */
+    unsigned int            used;   /* nodes ever handed out */
+    unsigned int            free;   /* free list head, 0 if empty */
+    unsigned int            count;  /* pending timeouts */
+} evlua_timer_wheel;
+
+/**
+ * An ev.Timeout, see timeout_lua_ev.c.  The ev_timer must be first.
+ */
+typedef struct {
+    ev_timer    timer;
+    ev_tstamp   timeout;  /* seconds without activity */
+    ev_tstamp   last;     /* loop time of the last activity */
+} evlua_timeout;
+
+/**
+ * State shared between an ev.Thread handle and the OS thread it
+ * started.  It is malloc()ed since the thread may outlive the handle,
+ * and freed by whichever drops the last reference.  Everything but
+ * tid and L is protected by lock.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_t       tid;
+    lua_State*      L;       /* the state the thread runs */
+    int             refs;    /* handle + running thread */
+    int             done;    /* the thread finished */
+    int             status;  /* lua_pcall() result of the thread */
+    struct ev_loop* notify;  /* loop to ev_async_send() to when done */
+    ev_async*       async;
+} evlua_thread_shared;
+
+/**
+ * An ev.Thread handle, see thread_lua_ev.c.  The ev_async must be
+ * first.
+ */
+typedef struct {
+    ev_async             async;
+    evlua_thread_shared* shared;
+    int                  joined;
+} evlua_thread;
+
+/**
+ * Max nesting of tables copied between the states of ev.Thread, and
+ * the characters that make ev.Thread.spawn() treat its argument as a
+ * module name rather than lua source.
+ */
+#define THREAD_COPY_DEPTH   32
+#define THREAD_MODULE_CHARS \
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_.-"
+
+/**
+ * An ev.Work request, see work_lua_ev.c.  Allocated with malloc() and
+ * handed from the loop thread to a worker and back.  The strings are
+ * kept alive by the table referenced by ref.
+ */
+typedef struct evlua_work_req {
+    struct evlua_work_req* next;
+    evlua_loop*            lp;
+    int                    op;
+    int                    ref;   /* registry ref to { on_done, args... } */
+    const char*            str1;  /* path or host */
+    const char*            str2;  /* data or service */
+    size_t                 len;   /* length of data, bytes read or written */
+    int                    fd;
+    int                    err;   /* errno, or the getaddrinfo() error */
+    char*                  buf;
+    struct addrinfo*       ai;
+    struct stat            st;
+} evlua_work_req;
+
+#define WORK_RESOLVE    1
+#define WORK_READ_FILE  2
+#define WORK_WRITE_FILE 3
+#define WORK_FSYNC      4
+#define WORK_STAT       5
+
+/**
+ * Default number of ev.Work threads.
+ */
+#define WORK_THREADS    4
+
+/**
+ * The EVBACKEND_* and EVFLAG_* values are enums, so constants added by
+ * newer versions of libev are checked for by version.
+ */
+#define EV_VERSION_AT_LEAST(major, minor) \
+    (EV_VERSION_MAJOR > (major) ||        \
+     (EV_VERSION_MAJOR == (major) && EV_VERSION_MINOR >= (minor)))
+
+#define TIMER_WHEEL_MAX_SLOTS (1 << 24)
+#define TIMER_WHEEL_MIN_NODES 64
+#define TIMER_WHEEL_MAX_NODES 0x40000000u
+
+/**
+ * Various "check" functions simply call obj_check() and do the
  * appropriate casting, with the exception of check_watcher which is
  * implemented as a C function.
  */
@@ -73,34 +512,77 @@
  * result.
  */
 #define check_loop(L, narg)                                      \
-    ((struct ev_loop**)    luaL_checkudata((L), (narg), LOOP_MT))
+    ((struct ev_loop**)    obj_check((L), (narg), OBJ_LOOP, LOOP_MT))
+
+#define check_evlua_loop(L, narg)                                \
+    ((evlua_loop*)         obj_check((L), (narg), OBJ_LOOP, LOOP_MT))
 
 #define check_timer(L, narg)                                     \
-    ((struct ev_timer*)    luaL_checkudata((L), (narg), TIMER_MT))
+    ((struct ev_timer*)    obj_check((L), (narg), OBJ_TIMER, TIMER_MT))
 
 #define check_io(L, narg)                                        \
-    ((struct ev_io*)       luaL_checkudata((L), (narg), IO_MT))
+    ((struct ev_io*)       obj_check((L), (narg), OBJ_IO, IO_MT))
 
 #define check_async(L, narg)                                        \
-    ((struct ev_async*)    luaL_checkudata((L), (narg), ASYNC_MT))
+    ((struct ev_async*)    obj_check((L), (narg), OBJ_ASYNC, ASYNC_MT))
 
 #define check_signal(L, narg)                                   \
-    ((struct ev_signal*)   luaL_checkudata((L), (narg), SIGNAL_MT))
+    ((struct ev_signal*)   obj_check((L), (narg), OBJ_SIGNAL, SIGNAL_MT))
 
 #define check_idle(L, narg)                                      \
-    ((struct ev_idle*)     luaL_checkudata((L), (narg), IDLE_MT))
+    ((struct ev_idle*)     obj_check((L), (narg), OBJ_IDLE, IDLE_MT))
 
 #define check_child(L, narg)                                      \
-    ((struct ev_child*)     luaL_checkudata((L), (narg), CHILD_MT))
+    ((struct ev_child*)     obj_check((L), (narg), OBJ_CHILD, CHILD_MT))
 
 #define check_stat(L, narg)                                      \
-    ((struct ev_stat*)     luaL_checkudata((L), (narg), STAT_MT))
+    ((struct ev_stat*)     obj_check((L), (narg), OBJ_STAT, STAT_MT))
+
+#define check_periodic(L, narg)                                  \
+    ((struct ev_periodic*) obj_check((L), (narg), OBJ_PERIODIC, PERIODIC_MT))
+
+#define check_prepare(L, narg)                                   \
+    ((struct ev_prepare*)  obj_check((L), (narg), OBJ_PREPARE, PREPARE_MT))
+
+#define check_check(L, narg)                                     \
+    ((struct ev_check*)    obj_check((L), (narg), OBJ_CHECK, CHECK_MT))
+
+#define check_embed(L, narg)                                     \
+    ((struct ev_embed*)    obj_check((L), (narg), OBJ_EMBED, EMBED_MT))
+
+#define check_reader(L, narg)                                    \
+    ((evlua_reader*)       obj_check((L), (narg), OBJ_READER, READER_MT))
+
+#define check_writer(L, narg)                                    \
+    ((evlua_writer*)       obj_check((L), (narg), OBJ_WRITER, WRITER_MT))
+
+#define check_timer_wheel(L, narg)                               \
+    ((evlua_timer_wheel*)  obj_check((L), (narg), OBJ_TIMER_WHEEL, TIMER_WHEEL_MT))
+
+#define check_timeout(L, narg)                                   \
+    ((evlua_timeout*)      obj_check((L), (narg), OBJ_TIMEOUT, TIMEOUT_MT))
+
+#define check_async_sender(L, narg)                              \
+    ((evlua_async_sender*) obj_check((L), (narg), OBJ_ASYNC_SENDER, ASYNC_SENDER_MT))
+
+#define check_pool(L, narg)                                      \
+    ((evlua_pool*)         obj_check((L), (narg), OBJ_POOL, POOL_MT))
+
+#define check_group(L, narg)                                     \
+    ((void*)               obj_check((L), (narg), OBJ_GROUP, GROUP_MT))
+
+#define check_thread(L, narg)                                    \
+    ((evlua_thread*)       obj_check((L), (narg), OBJ_THREAD, THREAD_MT))
 
 
 /**
  * Generic functions:
  */
+LUALIB_API int           luaopen_ev(lua_State *L);
 static int               version(lua_State *L);
+static int               supported_backends(lua_State *L);
+static int               recommended_backends(lua_State *L);
+static int               embeddable_backends(lua_State *L);
 static int               traceback(lua_State *L);
 
 /**
@@ -108,33 +590,60 @@ static int               traceback(lua_State *L);
  */
 static int               luaopen_ev_loop(lua_State *L);
 static int               create_loop_mt(lua_State *L);
+static void              create_loop_refs(lua_State *L);
+static void              loop_push(lua_State *L, evlua_loop* lp);
 static struct ev_loop**  loop_alloc(lua_State *L);
 static struct ev_loop**  check_loop_and_init(lua_State *L, int loop_i);
 static int               loop_new(lua_State *L);
 static int               loop_delete(lua_State *L);
 static void              loop_start_watcher(lua_State* L, int loop_i, int watcher_i, int is_daemon);
-static void              loop_stop_watcher(lua_State* L, int loop_i, int watcher_i);
+static void              loop_stop_watcher(lua_State* L, int watcher_i);
 static int               loop_is_default(lua_State *L);
 static int               loop_iteration(lua_State *L);
 static int               loop_depth(lua_State *L);
 static int               loop_now(lua_State *L);
 static int               loop_update_now(lua_State *L);
 static int               loop_loop(lua_State *L);
+static int               loop_run(lua_State *L);
+static int               loop_next_timeout(lua_State *L);
 static int               loop_unloop(lua_State *L);
 static int               loop_backend(lua_State *L);
+static const char*       loop_backend_name(unsigned int backend);
 static int               loop_fork(lua_State *L);
+static int               loop_io_collect_interval(lua_State *L);
+static int               loop_timeout_collect_interval(lua_State *L);
+static int               loop_adaptive_collect(lua_State *L);
+static void              loop_stats_init(evlua_loop* lp);
+static void              loop_stats_reset(evlua_loop* lp);
+static evlua_loop*       loop_hooked(struct ev_loop* loop);
+static void              loop_invoke_pending_cb(struct ev_loop* loop);
+static void              loop_release_cb(struct ev_loop* loop);
+static void              loop_acquire_cb(struct ev_loop* loop);
+static int               loop_stats(lua_State *L);
+static int               loop_profile(lua_State *L);
+static int               loop_rank_cmp(const void* a, const void* b);
+static int               loop_top_watchers(lua_State *L);
+static void              latency_record(evlua_latency* hist, ev_tstamp seconds);
+static ev_tstamp         latency_value(int bucket);
+static void              latency_push(lua_State *L, evlua_latency* hist);
+static void              loop_probe_cb(struct ev_loop* loop, ev_timer* probe, int revents);
+static int               loop_lag_probe(lua_State *L);
+static int               loop_latency(lua_State *L);
+static void              loop_callback_error(lua_State *L);
+static int               loop_on_error(lua_State *L);
+static void              loop_adapt_cb(struct ev_loop* loop, ev_prepare* prepare, int revents);
 
 /**
  * Object functions:
  */
 static void              create_obj_registry(lua_State *L);
 static int               obj_count(lua_State *L);
-static void*             obj_new(lua_State* L, size_t size, const char* tname);
+static void*             obj_new(lua_State* L, size_t size, const char* tname, int type);
+static uintptr_t         obj_type(lua_State *L, int obj_i);
+static void*             obj_check(lua_State *L, int obj_i, int type, const char* tname);
 static int               obj_newindex(lua_State *L);
 static int               obj_index(lua_State *L);
 
-static int               push_objs(lua_State* L, void** objs);
-
 /**
  * Watcher functions:
  */
@@ -142,10 +651,18 @@ static int                add_watcher_mt(lua_State *L);
 static int                watcher_is_active(lua_State *L);
 static int                watcher_is_pending(lua_State *L);
 static int                watcher_clear_pending(lua_State *L);
-static void*              watcher_new(lua_State* L, size_t size, const char* lua_type);
+static void*              watcher_new(lua_State* L, size_t size, const char* lua_type, int type);
+static int                watcher_push_fenv(lua_State *L, int watcher_i, int create);
+static void               watcher_push_fn(lua_State *L, int watcher_i);
+static void               watcher_set_fn(lua_State *L, int watcher_i);
 static int                watcher_callback(lua_State *L);
 static int                watcher_priority(lua_State *L);
 static void               watcher_cb(struct ev_loop *loop, void *watcher, int revents);
+static void               watcher_cb_args(struct ev_loop *loop, void *watcher, int revents, int nargs);
+static void               watcher_push_stats(lua_State *L, evlua_watcher_stats* stats);
+static int                watcher_stats(lua_State *L);
+static int                watcher_bind(lua_State *L);
+static int                watcher_bound_loop(lua_State *L, int loop_i);
 static struct ev_watcher* check_watcher(lua_State *L, int watcher_i);
 
 /**
@@ -154,6 +671,7 @@ static struct ev_watcher* check_watcher(lua_State *L, int watcher_i);
 static int               luaopen_ev_timer(lua_State *L);
 static int               create_timer_mt(lua_State *L);
 static int               timer_new(lua_State* L);
+static int               timer_pool(lua_State* L);
 static void              timer_cb(struct ev_loop* loop, ev_timer* timer, int revents);
 static int               timer_again(lua_State *L);
 static int               timer_stop(lua_State *L);
@@ -166,6 +684,7 @@ static int               timer_clear_pending(lua_State *L);
 static int               luaopen_ev_io(lua_State *L);
 static int               create_io_mt(lua_State *L);
 static int               io_new(lua_State* L);
+static int               io_pool(lua_State* L);
 static void              io_cb(struct ev_loop* loop, ev_io* io, int revents);
 static int               io_stop(lua_State *L);
 static int               io_start(lua_State *L);
@@ -181,6 +700,14 @@ static void              async_cb(struct ev_loop* loop, ev_async* async, int rev
 static int               async_send(lua_State *L);
 static int               async_stop(lua_State *L);
 static int               async_start(lua_State *L);
+static void              async_pool_set_loop(ev_async* async, struct ev_loop* loop);
+static void              async_pool_forget_loop(struct ev_loop* loop);
+static int               async_export(lua_State *L);
+static int               async_gc(lua_State *L);
+static int               create_async_sender_mt(lua_State *L);
+static int               async_import(lua_State *L);
+static int               async_sender_send(lua_State *L);
+static int               async_sender_gc(lua_State *L);
 
 /**
  * Signal functions:
@@ -226,3 +753,186 @@ static int               stat_stop(lua_State *L);
 static int               stat_start(lua_State *L);
 static int               stat_start(lua_State *L);
 static int               stat_getdata(lua_State *L);
+
+/**
+ * Periodic functions:
+ */
+static int               luaopen_ev_periodic(lua_State *L);
+static int               create_periodic_mt(lua_State *L);
+static int               periodic_new(lua_State* L);
+static void              periodic_cb(struct ev_loop* loop, ev_periodic* periodic, int revents);
+static ev_tstamp         periodic_localtime_reschedule(ev_periodic* periodic, ev_tstamp now);
+static int               periodic_again(lua_State *L);
+static int               periodic_stop(lua_State *L);
+static int               periodic_start(lua_State *L);
+static int               periodic_at(lua_State *L);
+static int               periodic_clear_pending(lua_State *L);
+
+/**
+ * Prepare functions:
+ */
+static int               luaopen_ev_prepare(lua_State *L);
+static int               create_prepare_mt(lua_State *L);
+static int               prepare_new(lua_State* L);
+static void              prepare_cb(struct ev_loop* loop, ev_prepare* prepare, int revents);
+static int               prepare_stop(lua_State *L);
+static int               prepare_start(lua_State *L);
+
+/**
+ * Check functions:
+ */
+static int               luaopen_ev_check(lua_State *L);
+static int               create_check_mt(lua_State *L);
+static int               check_new(lua_State* L);
+static void              check_cb(struct ev_loop* loop, ev_check* check, int revents);
+static int               check_stop(lua_State *L);
+static int               check_start(lua_State *L);
+
+/**
+ * Embed functions:
+ */
+static int               luaopen_ev_embed(lua_State *L);
+static int               create_embed_mt(lua_State *L);
+static int               embed_new(lua_State* L);
+static void              embed_cb(struct ev_loop* loop, ev_embed* embed, int revents);
+static void              embed_prepare_cb(struct ev_loop* loop, ev_prepare* prepare, int revents);
+static int               embed_stop(lua_State *L);
+static int               embed_start(lua_State *L);
+static int               embed_sweep(lua_State *L);
+
+/**
+ * Reader functions:
+ */
+static int               luaopen_ev_reader(lua_State *L);
+static int               create_reader_mt(lua_State *L);
+static int               reader_new(lua_State* L);
+static void              reader_cb(struct ev_loop* loop, ev_io* io, int revents);
+static int               reader_stop(lua_State *L);
+static int               reader_start(lua_State *L);
+static int               reader_getfd(lua_State *L);
+static int               reader_budget(lua_State *L);
+
+/**
+ * Writer functions:
+ */
+static int               luaopen_ev_writer(lua_State *L);
+static int               create_writer_mt(lua_State *L);
+static int               writer_new(lua_State* L);
+static int               writer_flush(lua_State* L, evlua_writer* writer, int queue_i);
+static void              writer_drain(struct ev_loop* loop, evlua_writer* writer);
+static void              writer_cb(struct ev_loop* loop, ev_io* io, int revents);
+static void              writer_prepare_cb(struct ev_loop* loop, ev_prepare* prepare, int revents);
+static int               writer_write(lua_State *L);
+static int               writer_cork(lua_State *L);
+static int               writer_queued(lua_State *L);
+static int               writer_stop(lua_State *L);
+static int               writer_start(lua_State *L);
+static int               writer_getfd(lua_State *L);
+
+/**
+ * TimerWheel functions:
+ */
+static int               luaopen_ev_timer_wheel(lua_State *L);
+static int               create_timer_wheel_mt(lua_State *L);
+static int               timer_wheel_new(lua_State* L);
+static unsigned int      timer_wheel_alloc(lua_State* L, evlua_timer_wheel* wheel, int fenv_i);
+static void              timer_wheel_link(evlua_timer_wheel* wheel, unsigned int i);
+static void              timer_wheel_unlink(evlua_timer_wheel* wheel, unsigned int i);
+static void              timer_wheel_cb(struct ev_loop* loop, ev_timer* timer, int revents);
+static int               timer_wheel_add(lua_State *L);
+static int               timer_wheel_reset(lua_State *L);
+static int               timer_wheel_cancel(lua_State *L);
+static int               timer_wheel_count(lua_State *L);
+
+/**
+ * Timeout functions:
+ */
+static int               luaopen_ev_timeout(lua_State *L);
+static int               create_timeout_mt(lua_State *L);
+static int               timeout_new(lua_State* L);
+static void              timeout_cb(struct ev_loop* loop, ev_timer* timer, int revents);
+static int               timeout_touch(lua_State *L);
+static int               timeout_remaining(lua_State *L);
+static int               timeout_stop(lua_State *L);
+static int               timeout_start(lua_State *L);
+
+/**
+ * Thread functions:
+ */
+static int               luaopen_ev_thread(lua_State *L);
+static int               create_thread_mt(lua_State *L);
+static int               thread_is_spawned(lua_State *L);
+static int               thread_copy(lua_State* from, int from_i, lua_State* to, int depth);
+static void              thread_release(evlua_thread_shared* shared);
+static int               thread_run(lua_State *L);
+static void*             thread_main(void* arg);
+static int               thread_spawn(lua_State *L);
+static int               thread_noop(lua_State *L);
+static void              thread_push_result(lua_State *L, evlua_thread* thread);
+static void              thread_cb(struct ev_loop* loop, ev_async* async, int revents);
+static int               thread_join(lua_State *L);
+static int               thread_is_done(lua_State *L);
+static int               thread_stop(lua_State *L);
+static int               thread_start(lua_State *L);
+static void              thread_forget_loop(lua_State *L, int thread_i, struct ev_loop* loop);
+static int               thread_gc(lua_State *L);
+
+/**
+ * Work functions:
+ */
+static int               luaopen_ev_work(lua_State *L);
+static int               work_gc(lua_State *L);
+static evlua_work_req*   work_new(lua_State *L, int op);
+static void              work_submit(lua_State *L, evlua_work_req* req);
+static void*             work_main(void* arg);
+static void              work_run(evlua_work_req* req);
+static void              work_complete(evlua_work_req* req);
+static void              work_free(evlua_work_req* req);
+static void              work_push_result(lua_State *L, evlua_work_req* req);
+static void              work_async_cb(struct ev_loop* loop, ev_async* async, int revents);
+static void              work_drain(evlua_loop* lp);
+static int               work_resolve(lua_State *L);
+static int               work_read_file(lua_State *L);
+static int               work_write_file(lua_State *L);
+static int               work_fsync(lua_State *L);
+static int               work_stat(lua_State *L);
+static int               work_threads(lua_State *L);
+
+/**
+ * Pool functions:
+ */
+static int               create_pool_mt(lua_State *L);
+static int               pool_new(lua_State *L, int type);
+static int               pool_acquire(lua_State *L);
+static int               pool_release(lua_State *L);
+static int               pool_count(lua_State *L);
+
+/**
+ * Group functions:
+ */
+static int               luaopen_ev_group(lua_State *L);
+static int               create_group_mt(lua_State *L);
+static int               group_new(lua_State *L);
+static void              group_check_method(lua_State *L, int watcher_i, const char* name);
+static int               group_add(lua_State *L);
+static int               group_remove(lua_State *L);
+static int               group_count(lua_State *L);
+static void              group_call(lua_State *L, int watcher_i, const char* name);
+static int               group_start(lua_State *L);
+static int               group_stop(lua_State *L);
+static int               group_set_priority(lua_State *L);
+
+/**
+ * Coroutine functions:
+ */
+static int               luaopen_ev_co(lua_State *L);
+static void              co_check_yieldable(lua_State *L);
+static int               co_resume(lua_State *co, lua_State *from, int nargs);
+static void*             co_acquire(lua_State *L, int pool_i, lua_CFunction new_fn);
+static void              co_release(lua_State *L, int loop_i, int watcher_i);
+static void              co_park(lua_State *L, int watcher_i, int peer_i);
+static int               co_wakeup(lua_State *L);
+static void              co_cancel(lua_State *L, int watcher_i);
+static int               co_sleep(lua_State *L);
+static int               co_readable(lua_State *L);
+static int               co_wait(lua_State *L);
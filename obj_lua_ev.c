@@ -42,29 +42,80 @@ static int obj_count(lua_State *L) {
 
 /**
  * Create a new "object" with a metatable of tname and allocate size
- * bytes for the object.  Also create an fenv associated with the
- * object.  This fenv is used to keep track of lua objects so that the
- * garbage collector doesn't prematurely collect lua objects that are
- * referenced by the C data structure.
+ * bytes for the object, followed by the type tag (see OBJ_TAG()).
+ * Watchers, pools and groups also get an fenv.  This fenv is used to keep
+ * track of lua objects so that the garbage collector doesn't
+ * prematurely collect lua objects that are referenced by the C data
+ * structure.
+ *
+ * Compact watchers (see WATCHER_COMPACT) get two empty user values
+ * instead of an fenv, see watcher_push_fenv().
  *
  * [-0, +1, ?]
  */
-static void* obj_new(lua_State* L, size_t size, const char* tname) {
-    void* obj;
+static void* obj_new(lua_State* L, size_t size, const char* tname, int type) {
+    void*     obj;
+    uintptr_t tag;
+    size_t    len = OBJ_TAG_OFFSET(size) + sizeof(uintptr_t);
+
+#if WATCHER_COMPACT
+    obj = lua_newuserdatauv(L, len, (type & OBJ_WATCHER) ? 2 : 1);
+#else
+    obj = lua_newuserdata(L, len);
+#endif
+    if ( OBJ_POOL == type || OBJ_GROUP == type ||
+         ( ! WATCHER_COMPACT && (type & OBJ_WATCHER) ) )
+    {
+        /* Optimized for "watcher" creation that does not use a shadow
+         * table:
+         */
+        lua_createtable(L, 1, 0);
+        lua_setuservalue(L, -2);
+    }
+    tag = OBJ_TAG(obj, type);
+    memcpy((char*)obj + OBJ_TAG_OFFSET(size), &tag, sizeof(uintptr_t));
 
-    obj = lua_newuserdata(L, size);
     luaL_getmetatable(L,     tname);
     lua_setmetatable(L,      -2);
 
-    /* Optimized for "watcher" creation that does not use a shadow
-     * table:
-     */
-    lua_createtable(L, 1, 0);
-    lua_setuservalue(L, -2);
-
     return obj;
 }
 
+/**
+ * Returns the type tag of the object at obj_i, XORed back into the
+ * OBJ_* type if it is one of ours.  Anything that is not a full
+ * userdata yields 0.
+ *
+ * [-0, +0, -]
+ */
+static uintptr_t obj_type(lua_State *L, int obj_i) {
+    void*     obj = lua_touserdata(L, obj_i);
+    size_t    len;
+    uintptr_t tag;
+
+    if ( NULL == obj || LUA_TUSERDATA != lua_type(L, obj_i) ) return 0;
+
+    len = lua_rawlen(L, obj_i);
+    if ( len < sizeof(uintptr_t) ) return 0;
+
+    /* Foreign userdata may be of any size, so don't assume alignment: */
+    memcpy(&tag, (char*)obj + len - sizeof(uintptr_t), sizeof(uintptr_t));
+    return tag ^ OBJ_TAG(obj, 0);
+}
+
+/**
+ * Checks that obj_i is an object of the given OBJ_* type with a
+ * single compare of its type tag.  Falls back to luaL_checkudata(),
+ * which raises the usual error, if it is not.
+ *
+ * [-0, +0, v]
+ */
+static void* obj_check(lua_State *L, int obj_i, int type, const char* tname) {
+    if ( obj_type(L, obj_i) == (uintptr_t)type ) return lua_touserdata(L, obj_i);
+
+    return luaL_checkudata(L, obj_i, tname);
+}
+
 /**
  * Lazily create the shadow table, and provide write access to this
  * shadow table.
@@ -72,7 +123,7 @@ static void* obj_new(lua_State* L, size_t size, const char* tname) {
  * [-0, +0, ?]
  */
 static int obj_newindex(lua_State *L) {
-    lua_getuservalue(L, 1);
+    watcher_push_fenv(L, 1, 1);
     lua_rawgeti(L, -1, WATCHER_SHADOW);
 
     /* fenv, shadow */
@@ -103,7 +154,7 @@ static int obj_index(lua_State *L) {
         if ( ! lua_isnil(L, -1) ) return 1;
         lua_pop(L, 1);
     }
-    lua_getuservalue(L, 1);
+    if ( ! watcher_push_fenv(L, 1, 0) ) return 1;
     lua_rawgeti(L, -1, WATCHER_SHADOW);
 
     if ( lua_isnil(L, -1) ) return 1;
@@ -131,36 +182,3 @@ static void register_obj(lua_State*L, int obj_i, void* obj) {
     lua_rawset(L,            -3);
     lua_pop(L,               1);
 }
-
-/**
- * Pushes the lua representation of n objects onto the stack.  The
- * objs array must be NULL terminated.  Returns the number of objects
- * pushed onto the stack.
- *
- * [-0, +objs_len, m]
- */
-static int push_objs(lua_State* L, void** objs) {
-    int obj_count = 0;
-    int registry_i;
-    void** cur;
-
-    for ( cur=objs; *cur; ++cur ) obj_count++;
-
-    if ( 0 == obj_count ) return obj_count;
-
-    lua_checkstack(L, obj_count + 1);
-
-    lua_pushlightuserdata(L, &obj_registry);
-    lua_rawget(L,            LUA_REGISTRYINDEX);
-    assert(lua_istable(L, -1) /* create_obj_registry() should have ran */);
-
-    registry_i = lua_gettop(L);
-    for ( cur=objs; *cur; ++cur ) {
-        lua_pushlightuserdata(L, *cur);
-        lua_rawget(L, registry_i);
-    }
-
-    lua_remove(L, registry_i);
-
-    return obj_count;
-}
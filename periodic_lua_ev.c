@@ -0,0 +1,197 @@
+#include <time.h>
+
+/**
+ * Create a table for ev.Periodic that gives access to the constructor
+ * for periodic objects.
+ *
+ * [-0, +1, ?]
+ */
+static int luaopen_ev_periodic(lua_State *L) {
+    lua_pop(L, create_periodic_mt(L));
+
+    lua_createtable(L, 0, 1);
+
+    lua_pushcfunction(L, periodic_new);
+    lua_setfield(L, -2, "new");
+
+    return 1;
+}
+
+/**
+ * Create the periodic metatable in the registry.
+ *
+ * [-0, +1, ?]
+ */
+static int create_periodic_mt(lua_State *L) {
+
+    static luaL_Reg fns[] = {
+        { "again",         periodic_again },
+        { "stop",          periodic_stop },
+        { "start",         periodic_start },
+        { "at",            periodic_at },
+        { "clear_pending", periodic_clear_pending },
+        { NULL, NULL }
+    };
+    luaL_newmetatable(L, PERIODIC_MT);
+    add_watcher_mt(L);
+    luaL_setfuncs(L, fns, 0);
+
+    return 1;
+}
+
+/**
+ * Create a new periodic object.  Arguments:
+ *   1 - callback function.
+ *   2 - offset (absolute time for interval 0, else phase in seconds).
+ *   3 - interval (number of seconds between triggers, 0 for one shot).
+ *   4 - reschedule ("utc" which is the default, or "localtime").
+ *
+ * With the "localtime" reschedule mode the triggers are aligned to
+ * multiples of interval in local wall clock time (so an interval of
+ * 86400 with an offset of 0 means local midnight).  The next trigger
+ * time is computed in C by periodic_localtime_reschedule().
+ *
+ * @see watcher_new()
+ *
+ * [+1, -0, ?]
+ */
+static int periodic_new(lua_State* L) {
+    static const char* modes[] = { "utc", "localtime", NULL };
+
+    ev_tstamp    offset   = luaL_checknumber(L, 2);
+    ev_tstamp    interval = luaL_optnumber(L, 3, 0);
+    int          mode     = luaL_checkoption(L, 4, "utc", modes);
+    ev_periodic* periodic;
+
+    if ( interval < 0.0 )
+        luaL_argerror(L, 3, "interval must be greater than or equal to 0");
+    if ( 1 == mode && interval <= 0.0 )
+        luaL_argerror(L, 3, "localtime reschedule requires an interval");
+
+    periodic = watcher_new(L, sizeof(ev_periodic), PERIODIC_MT, OBJ_PERIODIC);
+    ev_periodic_init(periodic, &periodic_cb, offset, interval,
+                     1 == mode ? &periodic_localtime_reschedule : 0);
+    return 1;
+}
+
+/**
+ * @see watcher_cb()
+ *
+ * [+0, -0, m]
+ */
+static void periodic_cb(struct ev_loop* loop, ev_periodic* periodic, int revents) {
+    watcher_cb(loop, periodic, revents);
+}
+
+/**
+ * Reschedule callback that aligns triggers to multiples of interval
+ * (shifted by offset) in local time rather than UTC.  The UTC offset
+ * is looked up on every call so daylight saving changes are picked
+ * up.  Note that libev forbids calling back into the loop or lua
+ * from here.
+ */
+static ev_tstamp periodic_localtime_reschedule(ev_periodic* periodic, ev_tstamp now) {
+    time_t    secs  = (time_t)now;
+    ev_tstamp local;
+    struct tm tm;
+
+    localtime_r(&secs, &tm);
+    local = now + tm.tm_gmtoff - periodic->offset;
+
+    return periodic->offset - tm.tm_gmtoff +
+        (floor(local / periodic->interval) + 1) * periodic->interval;
+}
+
+/**
+ * Recompute the next trigger time, for example after the system clock
+ * was changed.
+ *
+ * Usage:
+ *    periodic:again(loop)
+ *
+ * [+0, -0, e]
+ */
+static int periodic_again(lua_State *L) {
+    ev_periodic*    periodic = check_periodic(L, 1);
+    struct ev_loop* loop     = *check_loop_and_init(L, 2);
+
+    ev_periodic_again(loop, periodic);
+    loop_start_watcher(L, 2, 1, -1);
+
+    return 0;
+}
+
+/**
+ * Stops the periodic so it won't be called by the specified event loop.
+ *
+ * Usage:
+ *     periodic:stop(loop)
+ *
+ * [+0, -0, e]
+ */
+static int periodic_stop(lua_State *L) {
+    ev_periodic*    periodic = check_periodic(L, 1);
+    struct ev_loop* loop     = *check_loop_and_init(L, 2);
+
+    loop_stop_watcher(L, 1);
+    ev_periodic_stop(loop, periodic);
+
+    return 0;
+}
+
+/**
+ * Starts the periodic so it will be called by the specified event loop.
+ *
+ * Usage:
+ *     periodic:start(loop [, is_daemon])
+ *
+ * [+0, -0, e]
+ */
+static int periodic_start(lua_State *L) {
+    ev_periodic*    periodic = check_periodic(L, 1);
+    struct ev_loop* loop     = *check_loop_and_init(L, 2);
+    int is_daemon            = lua_toboolean(L, 3);
+
+    ev_periodic_start(loop, periodic);
+    loop_start_watcher(L, 2, 1, is_daemon);
+
+    return 0;
+}
+
+/**
+ * Returns the absolute time at which the periodic will trigger next.
+ * Only meaningful while the periodic is active.
+ *
+ * Usage:
+ *     time = periodic:at()
+ *
+ * [+1, -0, e]
+ */
+static int periodic_at(lua_State *L) {
+    lua_pushnumber(L, ev_periodic_at(check_periodic(L, 1)));
+    return 1;
+}
+
+/**
+ * If the periodic is pending, return the revents and clear the
+ * pending status (so the periodic callback won't be called).
+ *
+ * Usage:
+ *   revents = periodic:clear_pending(loop)
+ *
+ * [+1, -0, e]
+ */
+static int periodic_clear_pending(lua_State *L) {
+    ev_periodic*    periodic = check_periodic(L, 1);
+    struct ev_loop* loop     = *check_loop_and_init(L, 2);
+
+    int revents = ev_clear_pending(loop, periodic);
+    if ( ! ev_is_active(periodic) &&
+         ( revents & EV_PERIODIC ) )
+    {
+        loop_stop_watcher(L, 1);
+    }
+
+    lua_pushnumber(L, revents);
+    return 1;
+}
@@ -0,0 +1,180 @@
+/**
+ * Create the pool metatable in the registry.  Pools are created by
+ * ev.Timer.pool() and ev.IO.pool().
+ *
+ * [-0, +1, ?]
+ */
+static int create_pool_mt(lua_State *L) {
+
+    static luaL_Reg fns[] = {
+        { "acquire",       pool_acquire },
+        { "release",       pool_release },
+        { "count",         pool_count },
+        { NULL, NULL }
+    };
+    luaL_newmetatable(L, POOL_MT);
+    luaL_setfuncs(L, fns, 0);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+
+    return 1;
+}
+
+/**
+ * Create a new pool of watchers of the given OBJ_TIMER or OBJ_IO type
+ * that keeps at most max (default 64) released watchers for reuse.
+ * The released watchers are kept in the fenv of the pool.
+ *
+ * [-0, +1, e]
+ */
+static int pool_new(lua_State *L, int type) {
+    lua_Integer max = luaL_optinteger(L, 1, 64);
+    evlua_pool* pool;
+
+    luaL_argcheck(L, max >= 0 && max <= INT_MAX, 1, "max must be between 0 and INT_MAX");
+
+    pool = (evlua_pool*)obj_new(L, sizeof(evlua_pool), POOL_MT, OBJ_POOL);
+    pool->type    = type;
+    pool->max     = (int)max;
+    pool->created = 0;
+
+    return 1;
+}
+
+/**
+ * Returns a stopped watcher of the pool's type, reusing a released
+ * one if there is any, with fn as its callback.  The remaining
+ * arguments are those of ev.Timer.new() (after, repeat) or ev.IO.new()
+ * (fd, events).  A reused watcher is reinitialized in place with
+ * ev_timer_set() or ev_io_set(), so no lua object is allocated.
+ *
+ * Usage:
+ *   timer = pool:acquire(on_timeout, after [, repeat])
+ *   io    = pool:acquire(on_io, fd, events)
+ *
+ * [-0, +1, e]
+ */
+static int pool_acquire(lua_State *L) {
+    evlua_pool* pool   = check_pool(L, 1);
+    ev_tstamp   after  = 0;
+    ev_tstamp   repeat = 0;
+    int         fd     = 0;
+    int         events = 0;
+    int         n;
+    void*       w;
+
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    if ( OBJ_TIMER == pool->type ) {
+        after  = luaL_checknumber(L, 3);
+        repeat = luaL_optnumber(L, 4, 0);
+        if ( repeat < 0.0 )
+            luaL_argerror(L, 4, "repeat must be greater than or equal to 0");
+    } else {
+#if LUA_VERSION_NUM > 502
+        fd     = (int)luaL_checkinteger(L, 3);
+        events = (int)luaL_checkinteger(L, 4);
+#else
+        fd     = luaL_checkint(L, 3);
+        events = luaL_checkint(L, 4);
+#endif
+    }
+
+    lua_getuservalue(L, 1);
+    n = (int)lua_rawlen(L, -1);
+    if ( 0 == n ) {
+        /* Nothing to reuse, let the constructor do the work: */
+        pool->created++;
+        lua_pop(L, 1);
+        lua_pushcfunction(L, OBJ_TIMER == pool->type ? timer_new : io_new);
+        lua_replace(L, 1);
+        lua_call(L, lua_gettop(L) - 1, 1);
+        return 1;
+    }
+
+    lua_rawgeti(L, -1, n);
+    lua_pushnil(L);
+    lua_rawseti(L, -3, n);
+    w = lua_touserdata(L, -1);
+
+    if ( OBJ_TIMER == pool->type ) {
+        ev_timer_set((ev_timer*)w, after, repeat);
+    } else {
+        ev_io_set((ev_io*)w, fd, events);
+    }
+    lua_pushvalue(L, 2);
+    watcher_set_fn(L, -2);
+
+    return 1;
+}
+
+/**
+ * Returns a stopped watcher acquired from this pool (or created with
+ * the constructor of the pool's type) to the pool.  Its callback,
+ * shadow table fields, profile and bound loop are dropped and its
+ * priority is reset.  The watcher must not be used again until it is
+ * returned by acquire().  If the pool already holds max watchers, the
+ * watcher is left to the garbage collector.
+ *
+ * Usage:
+ *   pool:release(watcher)
+ *
+ * [-0, +0, e]
+ */
+static int pool_release(lua_State *L) {
+    evlua_pool* pool = check_pool(L, 1);
+    ev_watcher* w    = (ev_watcher*)obj_check(L, 2, pool->type,
+                                              OBJ_TIMER == pool->type ? TIMER_MT : IO_MT);
+    int         n;
+
+    if ( ev_is_active(w) || ev_is_pending(w) || NULL != WATCHER_EXT(w)->loop )
+        luaL_argerror(L, 2, "watcher must be stopped");
+
+    /* Only released watchers have no callback: */
+    watcher_push_fn(L, 2);
+    if ( lua_isnil(L, -1) )
+        luaL_argerror(L, 2, "watcher was already released");
+    lua_pop(L, 1);
+
+    lua_pushnil(L);
+    watcher_set_fn(L, 2);
+#if WATCHER_COMPACT
+    lua_pushnil(L);
+    lua_setiuservalue(L, 2, 2);
+#else
+    lua_getuservalue(L, 2);
+    lua_pushnil(L);
+    lua_rawseti(L, -2, WATCHER_SHADOW);
+    lua_pushnil(L);
+    lua_rawseti(L, -2, WATCHER_STATS);
+    lua_pushnil(L);
+    lua_rawseti(L, -2, WATCHER_LOOP);
+    lua_pop(L, 1);
+#endif
+    ev_set_priority(w, 0);
+
+    lua_getuservalue(L, 1);
+    n = (int)lua_rawlen(L, -1);
+    if ( n < pool->max ) {
+        lua_pushvalue(L, 2);
+        lua_rawseti(L, -2, n + 1);
+    }
+    return 0;
+}
+
+/**
+ * Returns the number of released watchers waiting to be reused and
+ * the number of watchers the pool had to create.
+ *
+ * Usage:
+ *   idle, created = pool:count()
+ *
+ * [-0, +2, e]
+ */
+static int pool_count(lua_State *L) {
+    evlua_pool* pool = check_pool(L, 1);
+
+    lua_getuservalue(L, 1);
+    lua_pushinteger(L, (lua_Integer)lua_rawlen(L, -1));
+    lua_pushnumber(L, (lua_Number)pool->created);
+    return 2;
+}
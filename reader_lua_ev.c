@@ -0,0 +1,222 @@
+/**
+ * Create a table for ev.Reader that gives access to the constructor for
+ * reader objects.
+ *
+ * [-0, +1, ?]
+ */
+static int luaopen_ev_reader(lua_State *L) {
+    lua_pop(L, create_reader_mt(L));
+
+    lua_createtable(L, 0, 1);
+
+    lua_pushcfunction(L, reader_new);
+    lua_setfield(L, -2, "new");
+
+    return 1;
+}
+
+/**
+ * Create the reader metatable in the registry.
+ *
+ * [-0, +1, ?]
+ */
+static int create_reader_mt(lua_State *L) {
+
+    static luaL_Reg fns[] = {
+        { "stop",          reader_stop },
+        { "start",         reader_start },
+        { "getfd" ,        reader_getfd },
+        { "budget",        reader_budget },
+        { NULL, NULL }
+    };
+    luaL_newmetatable(L, READER_MT);
+    add_watcher_mt(L);
+    luaL_setfuncs(L, fns, 0);
+
+    return 1;
+}
+
+/**
+ * Create a new reader object.  The fd is switched to non-blocking
+ * mode.  Arguments:
+ *   1 - callback function.
+ *   2 - fd (file descriptor number)
+ *   3 - max bytes to read per callback (optional, default 64k)
+ *
+ * @see watcher_new()
+ *
+ * [+1, -0, ?]
+ */
+static int reader_new(lua_State* L) {
+#if LUA_VERSION_NUM > 502
+    int            fd     = (int)luaL_checkinteger(L, 2);
+#else
+    int            fd     = luaL_checkint(L, 2);
+#endif
+    lua_Integer    budget = luaL_optinteger(L, 3, READER_BUDGET);
+    evlua_reader*  reader;
+    int            flags;
+
+    luaL_argcheck(L, budget > 0, 3, "budget must be positive");
+
+    flags = fcntl(fd, F_GETFL);
+    if ( flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0 ) {
+        return luaL_error(L, "unable to make fd %d non-blocking: %s",
+                          fd, strerror(errno));
+    }
+
+    reader = watcher_new(L, sizeof(evlua_reader), READER_MT, OBJ_READER);
+    ev_io_init(&reader->io, &reader_cb, fd, EV_READ);
+    reader->budget = (size_t)budget;
+    return 1;
+}
+
+/**
+ * Reads from the fd until it would block, hits end of file, fails, or
+ * budget bytes have been read.  Each read() asks for the whole rest of
+ * the budget, into a buffer the loop keeps for all its readers (they
+ * never run concurrently), so draining the fd takes one system call in
+ * the common case.  Everything read is handed to the callback as a
+ * single string:
+ *
+ *     callback(loop, reader, revents, data [, status])
+ *
+ * status is nil while the fd stays open, "eof" when the peer closed,
+ * or an error message.  The reader is stopped before the callback on
+ * eof or error.  If the fd turned out to have nothing to read, the
+ * callback is not invoked at all.
+ *
+ * [+0, -0, m]
+ */
+static void reader_cb(struct ev_loop* loop, ev_io* io, int revents) {
+    lua_State*    L      = ev_userdata(loop);
+    evlua_reader* reader = (evlua_reader*)io;
+    evlua_loop*   lp     = WATCHER_EXT(reader)->loop;
+    size_t        total  = 0;
+    int           err    = 0;
+    int           eof    = 0;
+
+    if ( lp->read_buf_size < reader->budget ) {
+        char* read_buf = (char*)realloc(lp->read_buf, reader->budget);
+        if ( NULL == read_buf ) {
+            err = ENOMEM;
+        } else {
+            lp->read_buf      = read_buf;
+            lp->read_buf_size = reader->budget;
+        }
+    }
+
+    while ( ! err && total < reader->budget ) {
+        size_t  want = reader->budget - total;
+        ssize_t got  = read(io->fd, lp->read_buf + total, want);
+        if ( got > 0 ) {
+            total += (size_t)got;
+            /* A short read means the kernel buffer was drained: */
+            if ( (size_t)got < want ) break;
+        } else if ( got == 0 ) {
+            eof = 1;
+            break;
+        } else if ( errno == EINTR ) {
+            continue;
+        } else {
+            if ( errno != EAGAIN && errno != EWOULDBLOCK ) err = errno;
+            break;
+        }
+    }
+    lua_pushlstring(L, lp->read_buf, total);
+
+    if ( 0 == total && !eof && !err ) {
+        /* Spurious wakeup, nothing to report: */
+        lua_pop(L, 1);
+        return;
+    }
+
+    if ( eof || err ) {
+        ev_io_stop(loop, io);
+        if ( eof ) {
+            lua_pushliteral(L, "eof");
+        } else {
+            lua_pushstring(L, strerror(err));
+        }
+        watcher_cb_args(loop, io, revents, 2);
+    } else {
+        watcher_cb_args(loop, io, revents, 1);
+    }
+}
+
+/**
+ * Stops the reader so it won't be called by the specified event loop.
+ *
+ * Usage:
+ *     reader:stop(loop)
+ *
+ * [+0, -0, e]
+ */
+static int reader_stop(lua_State *L) {
+    evlua_reader*   reader = check_reader(L, 1);
+    struct ev_loop* loop   = *check_loop_and_init(L, 2);
+
+    loop_stop_watcher(L, 1);
+    ev_io_stop(loop, &reader->io);
+
+    return 0;
+}
+
+/**
+ * Starts the reader so it will be called by the specified event loop.
+ *
+ * Usage:
+ *     reader:start(loop [, is_daemon])
+ *
+ * [+0, -0, e]
+ */
+static int reader_start(lua_State *L) {
+    evlua_reader*   reader    = check_reader(L, 1);
+    struct ev_loop* loop      = *check_loop_and_init(L, 2);
+    int             is_daemon = lua_toboolean(L, 3);
+
+    ev_io_start(loop, &reader->io);
+    loop_start_watcher(L, 2, 1, is_daemon);
+
+    return 0;
+}
+
+/**
+ * Returns the file descriptor being read.
+ *
+ * Usage:
+ *     reader:getfd()
+ *
+ * [+1, -0, e]
+ */
+static int reader_getfd(lua_State *L) {
+    evlua_reader* reader = check_reader(L, 1);
+
+    lua_pushinteger(L, reader->io.fd);
+
+    return 1;
+}
+
+/**
+ * Returns the max bytes read per callback and optionally sets a new
+ * value.
+ *
+ * Usage:
+ *     old_budget = reader:budget([new_budget])
+ *
+ * [+1, -0, e]
+ */
+static int reader_budget(lua_State *L) {
+    evlua_reader* reader = check_reader(L, 1);
+    size_t        old    = reader->budget;
+
+    if ( ! lua_isnoneornil(L, 2) ) {
+        lua_Integer budget = luaL_checkinteger(L, 2);
+        luaL_argcheck(L, budget > 0, 2, "budget must be positive");
+        reader->budget = (size_t)budget;
+    }
+
+    lua_pushinteger(L, (lua_Integer)old);
+
+    return 1;
+}
@@ -51,7 +51,7 @@ static int signal_new(lua_State* L) {
 #endif
     ev_signal*  sig;
 
-    sig = watcher_new(L, sizeof(ev_signal), SIGNAL_MT);
+    sig = watcher_new(L, sizeof(ev_signal), SIGNAL_MT, OBJ_SIGNAL);
     ev_signal_init(sig, &signal_cb, signum);
     return 1;
 }
@@ -77,7 +77,7 @@ static int signal_stop(lua_State *L) {
     ev_signal*      sig  = check_signal(L, 1);
     struct ev_loop* loop = *check_loop_and_init(L, 2);
 
-    loop_stop_watcher(L, 2, 1);
+    loop_stop_watcher(L, 1);
     ev_signal_stop(loop, sig);
 
     return 0;
@@ -54,7 +54,7 @@ static int stat_new(lua_State* L) {
 #endif
     ev_stat*    stat;
 
-    stat = watcher_new(L, sizeof(ev_stat), STAT_MT);
+    stat = watcher_new(L, sizeof(ev_stat), STAT_MT, OBJ_STAT);
     ev_stat_init(stat, &stat_cb, path, interval);
     return 1;
 }
@@ -80,7 +80,7 @@ static int stat_stop(lua_State *L) {
     ev_stat*        stat  = check_stat(L, 1);
     struct ev_loop* loop = *check_loop_and_init(L, 2);
 
-    loop_stop_watcher(L, 2, 1);
+    loop_stop_watcher(L, 1);
     ev_stat_stop(loop, stat);
 
     return 0;
@@ -1,4 +1,4 @@
-print '1..3'
+print '1..13'
 
 local src_dir, build_dir = ...
 package.path  = src_dir .. "?.lua;" .. package.path
@@ -25,4 +25,40 @@ function test_basic()
    loop:loop()
 end
 
+-- An exported async can be woken up through an imported sender:
+function test_export()
+   local called = 0
+   local async1 = ev.Async.new(
+      function(loop, async, revents)
+         called = called + 1
+         async:stop(loop)
+      end)
+   async1:start(loop)
+   local token = async1:export()
+   ok(type(token) == "number", 'export returns a number')
+   ok(async1:export() == token, 'exporting again returns the same token')
+   local sender = ev.Async.import(token)
+   ok(sender:send(), 'send to a started async')
+   loop:loop()
+   ok(called == 1, 'async callback called once')
+   ok(sender:send() == false, 'send to a stopped async does nothing')
+   ok(not pcall(ev.Async.import, token + 1), 'invalid token is rejected')
+end
+
+-- Wake up the loop from another thread:
+function test_thread_send()
+   local async1 = ev.Async.new(
+      function(loop, async, revents)
+         ok(true, 'woken up by the thread')
+         async:stop(loop)
+      end)
+   async1:start(loop)
+   local thread = ev.Thread.spawn("return require('ev').Async.import(...):send()", { async1:export() })
+   loop:loop()
+   local success, sent = thread:join()
+   ok(success and sent, 'thread sent through the imported async')
+end
+
 noleaks(test_basic, "test_basic")
+noleaks(test_export, "test_export")
+noleaks(test_thread_send, "test_thread_send")
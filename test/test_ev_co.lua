@@ -0,0 +1,124 @@
+print '1..18'
+
+local src_dir, build_dir = ...
+package.path  = src_dir .. "?.lua;" .. package.path
+package.cpath = build_dir .. "?.so;" .. package.cpath
+
+local tap   = require("tap")
+local ev    = require("ev")
+local help  = require("help")
+local ok    = tap.ok
+
+local noleaks = help.collect_and_assert_no_watchers
+local loop = ev.Loop.default
+local has_socket, socket = pcall(require, "socket")
+
+-- ev.co keeps the watchers it is done with for reuse.  Fill its pools
+-- up front, so the leak checks count them in their base:
+local function fill_pools()
+   for i = 1, 2 do
+      coroutine.wrap(function() ev.co.sleep(loop, 0) end)()
+   end
+   if has_socket then
+      local server = assert(socket.bind("127.0.0.1", 0))
+      coroutine.wrap(function() ev.co.readable(loop, server:getfd(), 0) end)()
+      loop:loop()
+      server:close()
+   end
+   loop:loop()
+end
+
+-- Sleep in a coroutine:
+function test_sleep()
+   local done = false
+   coroutine.wrap(function()
+      local start = loop:update_now()
+      ev.co.sleep(loop, 0.01)
+      ok(loop:now() - start >= 0.009, 'slept for ' .. (loop:now() - start))
+      done = true
+   end)()
+   ok(not done, 'sleep suspended the coroutine')
+   loop:loop()
+   ok(done, 'coroutine resumed')
+end
+
+-- Waiting again reuses the pooled watchers, two concurrent sleepers
+-- only need the two timers fill_pools() left:
+function test_pool()
+   local function sleeper(n)
+      for i = 1, n do ev.co.sleep(loop, 0) end
+   end
+   coroutine.wrap(sleeper)(1)
+   loop:loop()
+   collectgarbage("collect")
+   local count = ev.object_count()
+   coroutine.wrap(sleeper)(10)
+   coroutine.wrap(sleeper)(10)
+   loop:loop()
+   collectgarbage("collect")
+   ok(ev.object_count() == count, 'no new watchers for two concurrent sleepers')
+end
+
+-- Wait for an async watcher:
+function test_wait()
+   local callback = function() ok(false, 'Should never be called!') end
+   local async1 = ev.Async.new(callback)
+   async1:start(loop)
+   local revents
+   coroutine.wrap(function()
+      revents = ev.co.wait(async1)
+      async1:stop(loop)
+   end)()
+   ok(async1:callback() ~= callback, 'waiting coroutine took over the callback')
+   async1:send(loop)
+   loop:loop()
+   ok(revents == ev.ASYNC, 'wait returned ev.ASYNC')
+   ok(async1:callback() == callback, 'callback was restored')
+end
+
+-- Stopping the async resumes a waiting coroutine with nil:
+function test_wait_stopped()
+   local callback = function() end
+   local async1 = ev.Async.new(callback)
+   async1:start(loop)
+   local resumed, revents = false, true
+   coroutine.wrap(function()
+      revents = ev.co.wait(async1)
+      resumed = true
+   end)()
+   async1:stop(loop)
+   ok(resumed and revents == nil, 'stop resumed the waiting coroutine with nil')
+   ok(async1:callback() == callback, 'callback was restored')
+end
+
+-- Must be called from a coroutine:
+function test_not_coroutine()
+   ok(not pcall(ev.co.sleep, loop, 0), 'sleep outside of a coroutine fails')
+end
+
+-- Wait for a socket to become readable:
+function test_readable()
+   if not has_socket then
+      ok(true, 'skip readable, no socket library')
+      ok(true, 'skip readable, no socket library')
+      return
+   end
+   local server = assert(socket.bind("127.0.0.1", 0))
+   server:settimeout(0)
+   coroutine.wrap(function()
+      ok(ev.co.readable(loop, server:getfd(), 0.01) == false, 'readable timed out')
+      local client = socket.connect(server:getsockname())
+      ok(ev.co.readable(loop, server:getfd(), 1) == true, 'readable after connect')
+      client:close()
+   end)()
+   loop:loop()
+   server:close()
+end
+
+fill_pools()
+noleaks(test_sleep, "test_sleep")
+noleaks(test_pool, "test_pool")
+noleaks(test_wait, "test_wait")
+noleaks(test_wait_stopped, "test_wait_stopped")
+noleaks(test_not_coroutine, "test_not_coroutine")
+noleaks(test_readable, "test_readable")
@@ -0,0 +1,124 @@
+local src_dir, build_dir = ...
+package.path  = src_dir .. "?.lua;" .. package.path
+package.cpath = build_dir .. "?.so;" .. package.cpath
+
+local ev    = require("ev")
+
+-- Pick a backend that can be embedded on this platform:
+local backend
+local usable = ev.supported_backends() % 256
+local embeddable = ev.embeddable_backends()
+for _, candidate in ipairs{ 4, 8, 32, 128 } do
+   if usable % (2 * candidate) >= candidate and
+      embeddable % (2 * candidate) >= candidate
+   then
+      backend = candidate
+      break
+   end
+end
+if not backend then
+   print('1..0 # Skipped: No embeddable backend available')
+   os.exit(0)
+end
+print '1..9'
+
+local tap   = require("tap")
+local help  = require("help")
+local ok    = tap.ok
+
+local noleaks = help.collect_and_assert_no_watchers
+local loop = ev.Loop.default
+
+ok(type(ev.recommended_backends()) == "number", 'recommended_backends() is a number')
+
+-- The embedded io watchers wait for data on a connected socket, stdout
+-- may be a file that the backend can not watch:
+local has_socket, socket = pcall(require, "socket")
+
+local function connected_pair()
+   local server = assert(socket.bind("127.0.0.1", 0))
+   local client = assert(socket.connect(server:getsockname()))
+   local peer   = assert(server:accept())
+   server:close()
+   return client, peer
+end
+
+-- An io watcher in the embedded loop fires when sweeping it:
+function test_sweep()
+   if not has_socket then
+      for i = 1, 3 do ok(true, 'skip sweep, no socket library') end
+      return
+   end
+   local client, peer = connected_pair()
+   local inner = ev.Loop.new(backend)
+   ok(inner:backend() == backend, 'inner loop uses backend ' .. backend)
+
+   local io1 = ev.IO.new(
+      function(loop, io, revents)
+         ok(loop == inner, 'io callback runs with the embedded loop')
+         io:stop(loop)
+      end, client:getfd(), ev.READ)
+   io1:start(inner)
+   peer:send("x")
+
+   local embed1 = ev.Embed.new(function() end, inner)
+   for i = 1, 10 do
+      if not io1:is_active() then break end
+      embed1:sweep(loop)
+   end
+   ok(not io1:is_active(), 'embed:sweep() ran the embedded io watcher')
+   io1:stop(inner)
+   client:close()
+   peer:close()
+end
+
+-- A started embed wakes the outer loop up for events of the inner one.
+-- The embed prepare iterates the inner loop while it has fd changes,
+-- so io1 is in the inner backend before the data arrives:
+function test_started()
+   if not has_socket then
+      for i = 1, 3 do ok(true, 'skip started embed, no socket library') end
+      return
+   end
+   local client, peer = connected_pair()
+   local inner = ev.Loop.new(backend)
+
+   local io1 = ev.IO.new(
+      function(loop, io, revents)
+         ok(loop == inner, 'io callback runs with the embedded loop')
+         io:stop(loop)
+      end, client:getfd(), ev.READ)
+   io1:start(inner)
+
+   local notified = false
+   local embed1 = ev.Embed.new(
+      function(loop, embed, revents)
+         -- The embedded loop was already swept:
+         if not io1:is_active() then
+            notified = ev.EMBED == revents
+            embed:stop(loop)
+         end
+      end, inner)
+   embed1:start(loop)
+
+   local send = ev.Timer.new(function() peer:send("x") end, 0.01)
+   send:start(loop)
+
+   -- Make sure a broken embed can not hang the test:
+   local guard = ev.Timer.new(
+      function(loop)
+         embed1:stop(loop)
+         io1:stop(inner)
+      end, 2)
+   guard:start(loop, true)
+
+   loop:loop()
+   guard:stop(loop)
+   ok(not io1:is_active(), 'embedded io fired')
+   ok(notified, 'embed callback was called with ev.EMBED')
+   client:close()
+   peer:close()
+end
+
+noleaks(test_sweep, "test_sweep")
+noleaks(test_started, "test_started")
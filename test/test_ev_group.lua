@@ -0,0 +1,88 @@
+print '1..17'
+
+local src_dir, build_dir = ...
+package.path  = src_dir .. "?.lua;" .. package.path
+package.cpath = build_dir .. "?.so;" .. package.cpath
+
+local tap   = require("tap")
+local ev    = require("ev")
+local help  = require("help")
+local ok    = tap.ok
+
+local noleaks = help.collect_and_assert_no_watchers
+local loop = ev.Loop.default
+
+-- Start and stop watchers of different types in one call:
+function test_start_stop()
+   local fired   = 0
+   local timer   = ev.Timer.new(function() fired = fired + 1 end, 10)
+   local io      = ev.IO.new(function() end, 0, ev.READ)
+   local idle    = ev.Idle.new(function(loop, idle) idle:stop(loop) end)
+   local timeout = ev.Timeout.new(function() end, 10)
+   local group   = ev.Group.new(timer, io):add(idle, timeout)
+   ok(group:count() == 4, 'four watchers in the group')
+
+   group:start(loop)
+   ok(timer:is_active() and io:is_active() and idle:is_active() and timeout:is_active(),
+      'all watchers started')
+   group:stop(loop)
+   ok(not (timer:is_active() or io:is_active() or idle:is_active() or timeout:is_active()),
+      'all watchers stopped')
+   ok(loop:next_timeout() == nil, 'stopped watchers were unregistered')
+
+   group:start(loop, true)
+   loop:loop()
+   ok(timer:is_active() and fired == 0, 'daemon group does not keep the loop running')
+   group:stop(loop)
+end
+
+-- Priorities can only change while all watchers are stopped:
+function test_priority()
+   local timer = ev.Timer.new(function() end, 10)
+   local idle  = ev.Idle.new(function() end)
+   local group = ev.Group.new(timer, idle)
+   group:set_priority(2)
+   ok(timer:priority() == 2 and idle:priority() == 2, 'priority set')
+   timer:start(loop)
+   ok(not pcall(group.set_priority, group, -1), 'fails with an active watcher')
+   ok(idle:priority() == 2, 'nothing changed')
+   timer:stop(loop)
+end
+
+-- A stopped one-shot timer stays pending until its callback runs:
+function test_priority_pending()
+   local late  = ev.Timer.new(function() end, 0)
+   local group = ev.Group.new(late)
+   local failed
+   local first = ev.Timer.new(function()
+      failed = late:is_pending() and not pcall(group.set_priority, group, 0)
+   end, 0)
+   late:priority(ev.MINPRI)
+   first:priority(ev.MAXPRI)
+   late:start(loop)
+   first:start(loop)
+   loop:loop()
+   ok(failed, 'fails with a pending watcher')
+end
+
+function test_remove()
+   local timer = ev.Timer.new(function() end, 10)
+   local idle  = ev.Idle.new(function() end)
+   local group = ev.Group.new(timer, idle)
+   ok(group:remove(timer) and not group:remove(timer) and group:count() == 1, 'removed once')
+   group:start(loop)
+   ok(idle:is_active() and not timer:is_active(), 'removed watcher is not started')
+   group:stop(loop)
+end
+
+function test_not_groupable()
+   local wheel = ev.TimerWheel.new(function() end, loop, 0.01, 8)
+   local ok_add, err = pcall(ev.Group.new, wheel)
+   ok(not ok_add and err:find("can not be grouped"), 'timer wheel is rejected: ' .. tostring(err))
+end
+
+noleaks(test_start_stop, "test_start_stop")
+noleaks(test_priority, "test_priority")
+noleaks(test_priority_pending, "test_priority_pending")
+noleaks(test_remove, "test_remove")
+noleaks(test_not_groupable, "test_not_groupable")
@@ -1,4 +1,4 @@
-print '1..9'
+print '1..52'
 
 local src_dir, build_dir = ...
 package.path  = src_dir .. "?.lua;" .. package.path
@@ -65,3 +65,198 @@ ok(ev.Loop.new(1):backend() == 1,
 
 ok(ev.Loop.new(2):backend() == 2,
    "Able to choose backend 2 (poll), fails on windows or if LIBEV_FLAGS environment variable excludes this backend")
+
+local id, name = ev.Loop.new(ev.BACKEND_SELECT + ev.FLAG_NOENV):backend()
+ok(id == ev.BACKEND_SELECT and name == "select", "backend name = " .. tostring(name))
+
+ok(not pcall(ev.Loop.new, ev.BACKEND_MASK - ev.BACKEND_ALL),
+   "creating a loop without any available backend fails")
+
+-- Drive the loop one iteration at a time:
+function test_run()
+   local loop = ev.Loop.default
+   ok(loop:next_timeout() == nil, 'no timeout without timers')
+   ok(loop:run{ nowait = true } == 0, 'nowait run without watchers invokes nothing')
+
+   local fired = 0
+   local timer1 = ev.Timer.new(function() fired = fired + 1 end, 10)
+   timer1:start(loop)
+   local timeout = loop:next_timeout()
+   ok(timeout and timeout > 9 and timeout <= 10, 'next_timeout=' .. tostring(timeout))
+   ok(loop:run{ nowait = true } == 0 and fired == 0, 'nowait run does not wait for the timer')
+   timer1:stop(loop)
+
+   local timer2 = ev.Timer.new(function() fired = fired + 1 end, 0.01)
+   timer2:start(loop)
+   ok(loop:run{ once = true } == 1 and fired == 1, 'once run invoked one callback')
+   ok(loop:next_timeout() == nil, 'no timeout after the timer fired')
+end
+
+help.collect_and_assert_no_watchers(test_run, "test_run")
+
+-- Collect intervals, fixed and adaptive:
+function test_collect_interval()
+   local loop = ev.Loop.new()
+   ok(loop:io_collect_interval(0.001) == 0, 'io collect interval defaults to 0')
+   ok(loop:io_collect_interval() == 0.001, 'io collect interval was set')
+   ok(loop:timeout_collect_interval(0.002) == 0 and loop:timeout_collect_interval() == 0.002,
+      'timeout collect interval was set')
+
+   loop:adaptive_collect(1/64, 10, 2)
+   ok(loop:io_collect_interval() == 0, 'adaptive mode starts at 0')
+   local timers = {}
+   for i = 1, 20 do
+      timers[i] = ev.Timer.new(function() end, 0)
+      timers[i]:start(loop)
+   end
+   loop:run{ nowait = true }
+   loop:run{ nowait = true }
+   ok(loop:io_collect_interval() == 1/1024, 'busy iteration raised the interval to ' .. loop:io_collect_interval())
+   loop:run{ nowait = true }
+   ok(loop:io_collect_interval() == 0, 'idle iteration dropped the interval')
+   loop:adaptive_collect(0)
+end
+
+help.collect_and_assert_no_watchers(test_collect_interval, "test_collect_interval")
+
+-- Counters collected by the libev hooks:
+function test_stats()
+   local loop  = ev.Loop.new()
+   local fired = 0
+   local timer = ev.Timer.new(function(loop, timer)
+      fired = fired + 1
+      if fired == 3 then timer:stop(loop) end
+   end, 0.01, 0.01)
+   loop:stats(true)
+   timer:start(loop)
+   loop:loop()
+   local stats = loop:stats(true)
+   ok(stats.callbacks == 3 and stats.iterations >= 3 and stats.invokes >= 3,
+      'counted ' .. stats.callbacks .. ' callbacks in ' .. stats.iterations .. ' iterations')
+   ok(stats.blocked >= 0.02 and stats.blocked <= stats.elapsed and stats.running >= 0,
+      'blocked ' .. stats.blocked .. ' of ' .. stats.elapsed .. ' seconds')
+   ok(loop:stats().callbacks == 0, 'reset')
+end
+
+help.collect_and_assert_no_watchers(test_stats, "test_stats")
+
+-- Per-watcher profiles:
+function test_profile()
+   local loop = ev.Loop.new()
+   ok(loop:profile(true) == false, 'profiling is off by default')
+   local slow_calls = 0
+   local slow = ev.Idle.new(function(loop, idle)
+      local start = loop:update_now()
+      while loop:update_now() - start < 0.002 do end
+      slow_calls = slow_calls + 1
+      if slow_calls == 3 then
+         idle:stop(loop)
+         loop:unloop()
+      end
+   end)
+   local fast = ev.Idle.new(function() error("oops") end)
+   slow:start(loop)
+   fast:start(loop)
+   loop:loop()
+   local stats = fast:stats()
+   ok(stats.calls >= 3 and stats.errors == stats.calls, 'errors counted: ' .. stats.errors)
+   slow:start(loop)
+   local top = loop:top_watchers(1)
+   ok(#top == 1 and top[1].watcher == slow and top[1].calls == 3 and top[1].max >= 0.0019,
+      'slowest watcher first')
+   ok(slow:stats(true).total >= 0.0059 and slow:stats().calls == 0, 'stats reset')
+   loop:profile(false)
+   slow:stop(loop)
+   fast:stop(loop)
+end
+
+help.collect_and_assert_no_watchers(test_profile, "test_profile")
+
+-- Lag probe and timer lateness:
+function test_latency()
+   local quiet = ev.Loop.new()
+   ev.Timer.new(function() end, 0.001):start(quiet)
+   quiet:loop()
+   ok(quiet:latency().timer.count == 0, 'timer lateness is off by default')
+
+   local loop = ev.Loop.new()
+   ok(loop:lag_probe(0.002) == 0, 'no lag probe by default')
+   local fired = 0
+   local timer = ev.Timer.new(function(loop, timer)
+      -- Hog the loop so the probe is late:
+      local start = loop:update_now()
+      while loop:update_now() - start < 0.01 do end
+      fired = fired + 1
+      if fired == 5 then timer:stop(loop) end
+   end, 0.01, 0.01)
+   timer:start(loop)
+   loop:loop()
+   local latency = loop:latency(true)
+   ok(latency.lag.count >= 3 and latency.lag.max >= 0.005,
+      'lag recorded: ' .. latency.lag.count .. ' max ' .. latency.lag.max)
+   ok(latency.timer.count == 5, 'timer lateness recorded')
+   local lag = latency.lag
+   ok(lag.p50 <= lag.p90 and lag.p90 <= lag.p99 and lag.p99 <= lag.p999 and lag.p999 <= lag.max,
+      'percentiles are ordered')
+   ok(loop:latency().timer.count == 0 and loop:lag_probe(0) == 0.002, 'reset')
+end
+
+help.collect_and_assert_no_watchers(test_latency, "test_latency")
+
+-- Errors go to the loop's handler, which may stop the watcher:
+function test_on_error()
+   local loop   = ev.Loop.new()
+   local errors = {}
+   ok(loop:on_error(function(loop, watcher, err)
+      errors[#errors + 1] = err
+      return "stop"
+   end) == nil, 'no handler by default')
+   local idle = ev.Idle.new(function() error("boom") end)
+   idle:start(loop)
+   loop:loop()
+   ok(#errors == 1 and errors[1]:find("boom"), 'handler got the error')
+   ok(not idle:is_active(), 'handler stopped the watcher')
+
+   local timer = ev.Timer.new(function() error("again") end, 0.001, 0.001)
+   loop:on_error(function() return "unloop" end)
+   timer:start(loop)
+   loop:loop()
+   ok(timer:is_active(), 'unloop returned from the loop')
+   timer:stop(loop)
+   ok(type(loop:on_error(nil)) == "function" and loop:on_error() == nil, 'handler removed')
+end
+
+help.collect_and_assert_no_watchers(test_on_error, "test_on_error")
+
+-- Watchers are unlinked from the middle, head and tail of the active
+-- list, and daemons do not keep the loop running:
+function test_active_list()
+   local loop   = ev.Loop.new()
+   local timers = {}
+   for i = 1, 100 do
+      timers[i] = ev.Timer.new(function() end, i)
+      timers[i]:start(loop)
+   end
+   for i = 1, 100, 2 do timers[i]:stop(loop) end
+   timers[100]:stop(loop)
+   local timeout = loop:next_timeout()
+   ok(timeout and timeout > 1 and timeout <= 2, 'next_timeout after unlinking=' .. tostring(timeout))
+   for i = 2, 98, 2 do timers[i]:start(loop, true) end
+   ok(loop:loop() == nil and loop:next_timeout() <= 2, 'daemon watchers do not keep the loop running')
+   for i = 2, 98, 2 do timers[i]:stop(loop) end
+   ok(loop:next_timeout() == nil, 'all watchers unlinked')
+end
+
+help.collect_and_assert_no_watchers(test_active_list, "test_active_list")
+
+-- Active watchers do not keep a dropped loop alive, the loop releases
+-- them when collected:
+function test_dropped_loop()
+   local loop = ev.Loop.new()
+   ev.Timer.new(function() end, 10):start(loop)
+   ev.IO.new(function() end, 0, ev.READ):start(loop)
+   loop = nil
+   collectgarbage("collect")
+end
+
+help.collect_and_assert_no_watchers(test_dropped_loop, "test_dropped_loop")
@@ -0,0 +1,62 @@
+print '1..10'
+
+local src_dir, build_dir = ...
+package.path  = src_dir .. "?.lua;" .. package.path
+package.cpath = build_dir .. "?.so;" .. package.cpath
+
+local tap   = require("tap")
+local ev    = require("ev")
+local help  = require("help")
+local ok    = tap.ok
+
+local noleaks = help.collect_and_assert_no_watchers
+local loop = ev.Loop.default
+
+-- A one shot periodic at an absolute time:
+function test_absolute()
+   local periodic1 = ev.Periodic.new(
+      function(loop, periodic, revents)
+         ok(true, 'absolute periodic fired')
+         ok(ev.PERIODIC == revents, 'ev.PERIODIC(' .. ev.PERIODIC .. ') == revents (' .. revents .. ')')
+      end,
+      loop:update_now() + 0.01)
+   periodic1:start(loop)
+   loop:loop()
+   ok(not periodic1:is_active(), 'one shot periodic is no longer active')
+end
+
+-- A repeating periodic aligned to the wall clock:
+function test_interval()
+   local count = 0
+   local periodic1 = ev.Periodic.new(
+      function(loop, periodic)
+         count = count + 1
+         if count == 3 then periodic:stop(loop) end
+      end,
+      0, 0.01)
+   periodic1:start(loop)
+   local at = periodic1:at()
+   ok(math.abs(at / 0.01 - math.floor(at / 0.01 + 0.5)) < 1e-3,
+      'trigger time is a multiple of the interval: ' .. at)
+   loop:loop()
+   ok(count == 3, 'periodic called thrice')
+end
+
+-- The localtime reschedule mode is computed in C:
+function test_localtime()
+   local periodic1 = ev.Periodic.new(
+      function(loop, periodic)
+         ok(false, 'Should never be called!')
+      end,
+      0, 3600, "localtime")
+   periodic1:start(loop, true)
+   local delta = periodic1:at() - loop:now()
+   ok(delta > 0 and delta <= 3600, 'next localtime trigger within one interval: ' .. delta)
+   periodic1:stop(loop)
+   ok(not pcall(ev.Periodic.new, function() end, 0, 0, "localtime"),
+      'localtime requires an interval')
+end
+
+noleaks(test_absolute, "test_absolute")
+noleaks(test_interval, "test_interval")
+noleaks(test_localtime, "test_localtime")
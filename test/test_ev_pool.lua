@@ -0,0 +1,65 @@
+print '1..13'
+
+local src_dir, build_dir = ...
+package.path  = src_dir .. "?.lua;" .. package.path
+package.cpath = build_dir .. "?.so;" .. package.cpath
+
+local tap   = require("tap")
+local ev    = require("ev")
+local help  = require("help")
+local ok    = tap.ok
+
+local noleaks = help.collect_and_assert_no_watchers
+local loop = ev.Loop.default
+
+-- Released timers are reused with the new callback and timeout:
+function test_timer_pool()
+   local pool  = ev.Timer.pool(2)
+   local fired = {}
+   local first = pool:acquire(function() fired[#fired + 1] = "first" end, 0.01)
+   first.user_data = "stale"
+   first:start(loop)
+   loop:loop()
+   pool:release(first)
+   ok(first:callback() == nil and first.user_data == nil, 'release dropped the callback and shadow fields')
+
+   local second = pool:acquire(function() fired[#fired + 1] = "second" end, 0.01, 0.01)
+   ok(second == first, 'the released timer was reused')
+   second:start(loop)
+   ok(second:is_active(), 'reused timer starts')
+   second:stop(loop)
+   ok(#fired == 1 and fired[1] == "first", 'reused timer got the new callback')
+
+   local idle, created = pool:count()
+   ok(idle == 0 and created == 1, 'one timer created, none idle')
+   pool:release(second)
+   ok(not pcall(pool.release, pool, second), 'releasing twice fails')
+end
+
+-- Only stopped watchers of the right type may be released:
+function test_release_checks()
+   local pool  = ev.Timer.pool()
+   local timer = pool:acquire(function() end, 10)
+   timer:start(loop)
+   ok(not pcall(pool.release, pool, timer), 'releasing an active watcher fails')
+   timer:stop(loop)
+   ok(not pcall(pool.release, pool, ev.IO.new(function() end, 0, ev.READ)),
+      'releasing a watcher of another type fails')
+end
+
+-- io watchers are reset to the new fd and events:
+function test_io_pool()
+   local pool = ev.IO.pool(1)
+   local io   = pool:acquire(function() end, 0, ev.READ)
+   pool:release(io)
+   pool:release(pool:acquire(function() end, 1, ev.WRITE))
+   io = pool:acquire(function() end, 2, ev.READ)
+   ok(io:getfd() == 2, 'reused io watcher has the new fd')
+   pool:release(io)
+   pool:release(ev.IO.new(function() end, 3, ev.READ))
+   ok(pool:count() == 1, 'the pool keeps at most max watchers')
+end
+
+noleaks(test_timer_pool, "test_timer_pool")
+noleaks(test_release_checks, "test_release_checks")
+noleaks(test_io_pool, "test_io_pool")
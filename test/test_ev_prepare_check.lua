@@ -0,0 +1,59 @@
+print '1..7'
+
+local src_dir, build_dir = ...
+package.path  = src_dir .. "?.lua;" .. package.path
+package.cpath = build_dir .. "?.so;" .. package.cpath
+
+local tap   = require("tap")
+local ev    = require("ev")
+local help  = require("help")
+local ok    = tap.ok
+
+local noleaks = help.collect_and_assert_no_watchers
+local loop = ev.Loop.default
+
+-- Simply see if prepare and check watchers work at all:
+function test_basic()
+   local prepare1 = ev.Prepare.new(
+      function(loop, prepare, revents)
+         ok(ev.PREPARE == revents, 'ev.PREPARE(' .. ev.PREPARE .. ') == revents (' .. revents .. ')')
+         prepare:stop(loop)
+      end)
+   prepare1:start(loop)
+   local check1 = ev.Check.new(
+      function(loop, check, revents)
+         ok(ev.CHECK == revents, 'ev.CHECK(' .. ev.CHECK .. ') == revents (' .. revents .. ')')
+         check:stop(loop)
+      end)
+   check1:start(loop)
+   -- Nothing else wakes the poll up once the prepare stopped:
+   local timer1 = ev.Timer.new(function() end, 0.01)
+   timer1:start(loop)
+   loop:loop()
+end
+
+-- Prepare runs before the loop blocks, check right after it wakes up:
+function test_order()
+   local events = {}
+   local prepare1 = ev.Prepare.new(
+      function() events[#events + 1] = "p" end)
+   local check1 = ev.Check.new(
+      function() events[#events + 1] = "c" end)
+   local timer1 = ev.Timer.new(
+      function() events[#events + 1] = "t" end, 0.01)
+
+   prepare1:start(loop, true)
+   check1:start(loop, true)
+   timer1:start(loop)
+   loop:loop()
+   prepare1:stop(loop)
+   check1:stop(loop)
+
+   local seq = table.concat(events)
+   ok(seq:sub(1, 2) == "pc", 'prepare ran before check: ' .. seq)
+   ok(not seq:find("pp") and not seq:find("cc"), 'one prepare and one check per iteration: ' .. seq)
+   ok(seq:find("t"), 'timer fired: ' .. seq)
+end
+
+noleaks(test_basic, "test_basic")
+noleaks(test_order, "test_order")
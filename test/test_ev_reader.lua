@@ -0,0 +1,87 @@
+local src_dir, build_dir = ...
+package.path  = src_dir .. "?.lua;" .. package.path
+package.cpath = build_dir .. "?.so;" .. package.cpath
+
+-- This test relies on socket support:
+local has_socket, socket = pcall(require, "socket")
+if not has_socket then
+   print('1..0 # Skipped: No socket library available (' .. socket .. ')')
+   os.exit(0)
+end
+print '1..10'
+
+local tap   = require("tap")
+local ev    = require("ev")
+local help  = require("help")
+local ok    = tap.ok
+
+local noleaks = help.collect_and_assert_no_watchers
+local loop = ev.Loop.default
+
+-- Returns a connected client, server-side connection pair:
+local function socketpair()
+   local server = assert(socket.bind("127.0.0.1", 0))
+   local client = assert(socket.connect(server:getsockname()))
+   local conn   = assert(server:accept())
+   server:close()
+   return client, conn
+end
+
+-- Everything that is buffered is handed over in one callback:
+function test_drain()
+   local client, conn = socketpair()
+   client:send("hello")
+   client:send("world")
+   local reader = ev.Reader.new(
+      function(loop, reader, revents, data, status)
+         ok(data == "helloworld", 'got both writes in one chunk: ' .. tostring(data))
+         ok(status == nil, 'no status while open')
+         reader:stop(loop)
+      end, conn:getfd())
+   reader:start(loop)
+   loop:loop()
+   client:close()
+   conn:close()
+end
+
+-- The budget limits how much is read per callback:
+function test_budget()
+   local client, conn = socketpair()
+   client:send("0123456789")
+   local chunks = {}
+   local reader = ev.Reader.new(
+      function(loop, reader, revents, data)
+         chunks[#chunks + 1] = data
+         if #table.concat(chunks) == 10 then reader:stop(loop) end
+      end, conn:getfd(), 4)
+   reader:start(loop)
+   loop:loop()
+   ok(table.concat(chunks, ",") == "0123,4567,89", 'read in budget sized chunks: ' .. table.concat(chunks, ","))
+   ok(reader:budget(8) == 4 and reader:budget() == 8, 'budget get/set')
+   client:close()
+   conn:close()
+end
+
+-- Peer close reports "eof" and stops the reader:
+function test_eof()
+   local client, conn = socketpair()
+   client:send("bye")
+   client:close()
+   local got = {}
+   local reader = ev.Reader.new(
+      function(loop, reader, revents, data, status)
+         got[#got + 1] = data
+         if status then
+            ok(status == "eof", 'status is eof: ' .. tostring(status))
+            ok(table.concat(got) == "bye", 'got data before eof')
+            ok(not reader:is_active(), 'reader stopped on eof')
+         end
+      end, conn:getfd())
+   reader:start(loop)
+   loop:loop()
+   conn:close()
+end
+
+noleaks(test_drain, "test_drain")
+noleaks(test_budget, "test_budget")
+noleaks(test_eof, "test_eof")
@@ -0,0 +1,55 @@
+print '1..11'
+
+local src_dir, build_dir = ...
+package.path  = src_dir .. "?.lua;" .. package.path
+package.cpath = build_dir .. "?.so;" .. package.cpath
+
+local tap   = require("tap")
+local ev    = require("ev")
+local help  = require("help")
+local ok    = tap.ok
+
+local noleaks = help.collect_and_assert_no_watchers
+local loop = ev.Loop.default
+
+-- on_exit is delivered through the parent loop:
+function test_on_exit()
+   local thread = ev.Thread.spawn("local a, b = ... return a + b", { 1, 2 },
+      function(loop, thread, revents, success, result)
+         ok(success, 'thread succeeded')
+         ok(result == 3, 'got result: ' .. tostring(result))
+      end)
+   thread:start(loop)
+   loop:loop()
+end
+
+-- The thread runs a loop of its own after the chunk returns:
+function test_thread_loop()
+   local thread = ev.Thread.spawn([[
+      local ev     = require("ev")
+      local result = { is_default = ev.Loop.default:is_default() }
+      ev.Timer.new(function() result.fired = true end, 0.01):start(ev.Loop.default)
+      return result
+   ]])
+   local success, result = thread:join()
+   ok(success and result.fired, 'timer fired in the thread loop')
+   ok(result.is_default == false and thread:is_done(), 'thread does not use the libev default loop')
+end
+
+-- Errors are reported by join():
+function test_error()
+   local success, err = ev.Thread.spawn("error('boom')"):join()
+   ok(not success and err:find("boom"), 'got error: ' .. tostring(err))
+end
+
+-- Arguments are deep copied, functions can not be:
+function test_args()
+   local success, result = ev.Thread.spawn("local t = ... return t.x[1]", { { x = { "deep" } } }):join()
+   ok(result == "deep", 'nested table argument: ' .. tostring(result))
+   ok(not pcall(ev.Thread.spawn, "return 1", { print }), 'functions are rejected')
+end
+
+noleaks(test_on_exit, "test_on_exit")
+noleaks(test_thread_loop, "test_thread_loop")
+noleaks(test_error, "test_error")
+noleaks(test_args, "test_args")
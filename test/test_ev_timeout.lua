@@ -0,0 +1,50 @@
+print '1..7'
+
+local src_dir, build_dir = ...
+package.path  = src_dir .. "?.lua;" .. package.path
+package.cpath = build_dir .. "?.so;" .. package.cpath
+
+local tap   = require("tap")
+local ev    = require("ev")
+local help  = require("help")
+local ok    = tap.ok
+
+local noleaks = help.collect_and_assert_no_watchers
+local loop = ev.Loop.default
+
+-- Without activity the timeout fires once:
+function test_expire()
+   local start = loop:update_now()
+   local timeout = ev.Timeout.new(
+      function(loop, timeout, revents)
+         ok(loop:now() - start >= 0.019, 'fired after the timeout')
+      end, 0.02)
+   timeout:start(loop)
+   loop:loop()
+   ok(not timeout:is_active() and timeout:remaining() == nil, 'stopped after firing')
+end
+
+-- Each touch pushes the timeout back:
+function test_touch()
+   local start   = loop:update_now()
+   local touches = 0
+   local timeout = ev.Timeout.new(
+      function(loop, timeout, revents)
+         ok(touches == 4, 'touched 4 times: ' .. touches)
+         ok(loop:now() - start >= 0.069, 'fired 0.03 after the last touch: ' .. (loop:now() - start))
+      end, 0.03)
+   local activity = ev.Timer.new(
+      function(loop, timer)
+         touches = touches + 1
+         timeout:touch()
+         if touches == 4 then timer:stop(loop) end
+      end, 0.01, 0.01)
+   timeout:start(loop)
+   activity:start(loop)
+   local remaining = timeout:remaining()
+   ok(remaining > 0 and remaining <= 0.03, 'remaining after start: ' .. remaining)
+   loop:loop()
+end
+
+noleaks(test_expire, "test_expire")
+noleaks(test_touch, "test_touch")
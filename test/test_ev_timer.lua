@@ -1,4 +1,4 @@
-print '1..20'
+print '1..26'
 
 local src_dir, build_dir = ...
 package.path  = src_dir .. "?.lua;" .. package.path
@@ -189,6 +189,23 @@ function test_clear_pending()
 end
 
 
+-- Watchers bound to a loop don't need the loop argument:
+function test_bind()
+   local other = ev.Loop.new()
+   local fired = 0
+   local timer = ev.Timer.new(function(loop, timer)
+      fired = fired + 1
+      ok(loop == other, 'callback got the bound loop')
+   end, 0.01):bind(other)
+   ok(getmetatable(timer) and timer:is_active() == false, 'bind returns the watcher')
+   timer:start()
+   ok(timer:is_active(), 'started in the bound loop')
+   other:loop()
+   ok(fired == 1, 'fired once')
+   timer:bind(nil)
+   ok(not pcall(timer.start, timer), 'unbound watcher needs a loop')
+end
+
 noleaks(test_basic, "test_basic")
 noleaks(test_daemon_true, "test_daemon_true")
 noleaks(test_again, "test_again")
@@ -196,6 +213,7 @@ noleaks(test_start_stop_active, "test_start_stop_active")
 noleaks(test_callback, "test_callback")
 noleaks(test_is_pending, "test_is_pending")
 noleaks(test_clear_pending, "test_clear_pending")
+noleaks(test_bind, "test_bind")
 --print(dump("registry", debug.getregistry()[1]));
 
 -- test_is_pending()
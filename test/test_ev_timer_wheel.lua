@@ -0,0 +1,51 @@
+print '1..10'
+
+local src_dir, build_dir = ...
+package.path  = src_dir .. "?.lua;" .. package.path
+package.cpath = build_dir .. "?.so;" .. package.cpath
+
+local tap   = require("tap")
+local ev    = require("ev")
+local help  = require("help")
+local ok    = tap.ok
+
+local noleaks = help.collect_and_assert_no_watchers
+local loop = ev.Loop.default
+
+-- Timeouts expire in batches, and not before they are due:
+function test_expire()
+   local batches = {}
+   local start   = loop:update_now()
+   local wheel = ev.TimerWheel.new(
+      function(loop, wheel, revents, keys)
+         table.sort(keys)
+         batches[#batches + 1] = table.concat(keys, ",")
+         ok(loop:now() - start >= 0.019, 'not expired early')
+      end, loop, 0.01, 8)
+   wheel:add(1, 0.02)
+   wheel:add(2, 0.02)
+   wheel:add(3, 0.05)
+   ok(wheel:count() == 3, 'count is 3')
+   loop:loop()
+   ok(table.concat(batches, "|") == "1,2|3", 'expired in batches: ' .. table.concat(batches, "|"))
+   ok(wheel:count() == 0 and not wheel:is_active(), 'wheel is idle once empty')
+end
+
+-- Cancelled and reset timeouts, and timeouts longer than a turn:
+function test_cancel_reset()
+   local expired = {}
+   local wheel = ev.TimerWheel.new(
+      function(loop, wheel, revents, keys)
+         for _, key in ipairs(keys) do expired[#expired + 1] = key end
+      end, loop, 0.01, 4)
+   wheel:add("a", 0.02)
+   wheel:add("b", 0.02)
+   wheel:add("c", 0.1)
+   ok(wheel:cancel("a") and not wheel:cancel("a"), 'cancel')
+   ok(wheel:reset("b") and not wheel:reset("a"), 'reset')
+   loop:loop()
+   ok(table.concat(expired, ",") == "b,c", 'cancelled key did not expire: ' .. table.concat(expired, ","))
+end
+
+noleaks(test_expire, "test_expire")
+noleaks(test_cancel_reset, "test_cancel_reset")
@@ -0,0 +1,64 @@
+print '1..12'
+
+local src_dir, build_dir = ...
+package.path  = src_dir .. "?.lua;" .. package.path
+package.cpath = build_dir .. "?.so;" .. package.cpath
+
+local tap   = require("tap")
+local ev    = require("ev")
+local help  = require("help")
+local ok    = tap.ok
+
+local noleaks = help.collect_and_assert_no_watchers
+local loop = ev.Loop.default
+
+-- Write a file, then read and stat it back:
+function test_files()
+   local path = os.tmpname()
+   local data = string.rep("0123456789", 1000)
+   local done = {}
+   ev.Work.write_file(
+      function(loop, bytes, err)
+         ok(bytes == #data, 'wrote ' .. tostring(bytes) .. ' bytes ' .. tostring(err))
+         ev.Work.read_file(
+            function(loop, content, err)
+               ok(content == data, 'read back what was written')
+               done[#done + 1] = "read"
+            end, loop, path)
+         ev.Work.stat(
+            function(loop, st, err)
+               ok(st and st.size == #data and st.is_file and not st.is_dir, 'stat of the file')
+               done[#done + 1] = "stat"
+            end, loop, path)
+      end, loop, path, data)
+   loop:loop()
+   ok(#done == 2, 'the loop ran until all the work was done')
+   os.remove(path)
+end
+
+-- Failures are reported as nil, err:
+function test_errors()
+   local fails = 0
+   local function failed(loop, result, err)
+      ok(result == nil and type(err) == "string", 'failed with: ' .. tostring(err))
+      fails = fails + 1
+   end
+   ev.Work.read_file(failed, loop, "/nonexistent/ev-work-test")
+   ev.Work.fsync(failed, loop, -1)
+   loop:loop()
+   ok(fails == 2, 'both failures delivered')
+end
+
+-- Numeric hosts resolve without touching DNS:
+function test_resolve()
+   ev.Work.resolve(
+      function(loop, addrs, err)
+         ok(addrs and addrs[1] == "127.0.0.1", 'resolved 127.0.0.1 ' .. tostring(err))
+      end, loop, "127.0.0.1", "80")
+   loop:loop()
+   ok(ev.Work.threads() >= 1, 'pool has threads')
+end
+
+noleaks(test_files, "test_files")
+noleaks(test_errors, "test_errors")
+noleaks(test_resolve, "test_resolve")
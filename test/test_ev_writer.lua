@@ -0,0 +1,86 @@
+local src_dir, build_dir = ...
+package.path  = src_dir .. "?.lua;" .. package.path
+package.cpath = build_dir .. "?.so;" .. package.cpath
+
+-- This test relies on socket support:
+local has_socket, socket = pcall(require, "socket")
+if not has_socket then
+   print('1..0 # Skipped: No socket library available (' .. socket .. ')')
+   os.exit(0)
+end
+print '1..10'
+
+local tap   = require("tap")
+local ev    = require("ev")
+local help  = require("help")
+local ok    = tap.ok
+
+local noleaks = help.collect_and_assert_no_watchers
+local loop = ev.Loop.default
+
+-- Returns a connected client, server-side connection pair:
+local function socketpair()
+   local server = assert(socket.bind("127.0.0.1", 0))
+   local client = assert(socket.connect(server:getsockname()))
+   local conn   = assert(server:accept())
+   server:close()
+   conn:settimeout(1)
+   return client, conn
+end
+
+-- Without corking, writes go out right away:
+function test_write()
+   local client, conn = socketpair()
+   local writer = ev.Writer.new(function() end, client:getfd())
+   writer:start(loop)
+   ok(writer:write("hello") and writer:write("world"), 'below high water')
+   ok(conn:receive(10) == "helloworld", 'data was written')
+   writer:stop(loop)
+   client:close()
+   conn:close()
+end
+
+-- A corked writer flushes everything at the end of the iteration:
+function test_cork()
+   local client, conn = socketpair()
+   local writer = ev.Writer.new(function() end, client:getfd())
+   writer:cork(true)
+   writer:start(loop)
+   local idle = ev.Idle.new(
+      function(loop, idle)
+         idle:stop(loop)
+         writer:write("one,")
+         writer:write("two,")
+         writer:write("three")
+         ok(writer:queued() == 13, 'corked writes are queued: ' .. writer:queued())
+      end)
+   idle:start(loop)
+   loop:loop()
+   ok(writer:queued() == 0, 'queue flushed by the loop')
+   ok(conn:receive(13) == "one,two,three", 'data was written in order')
+   writer:stop(loop)
+   client:close()
+   conn:close()
+end
+
+-- Reaching the high water mark is reported, and so is draining:
+function test_water_marks()
+   local client, conn = socketpair()
+   local events = {}
+   local writer = ev.Writer.new(
+      function(loop, writer, revents, event)
+         events[#events + 1] = event
+      end, client:getfd(), 8, 2)
+   writer:cork(true)
+   writer:start(loop)
+   ok(writer:write("0123456789") == false, 'write returns false at high water')
+   loop:loop()
+   ok(table.concat(events, ",") == "low", 'got low water event: ' .. table.concat(events, ","))
+   writer:stop(loop)
+   client:close()
+   conn:close()
+end
+
+noleaks(test_write, "test_write")
+noleaks(test_cork, "test_cork")
+noleaks(test_water_marks, "test_water_marks")
@@ -0,0 +1,482 @@
+/**
+ * Registry key that marks a lua_State created by ev.Thread.spawn().
+ */
+static char* thread_registry = "ev{thread}";
+
+/**
+ * Create a table for ev.Thread that gives access to spawn().
+ *
+ * [-0, +1, ?]
+ */
+static int luaopen_ev_thread(lua_State *L) {
+    lua_pop(L, create_thread_mt(L));
+
+    lua_createtable(L, 0, 1);
+
+    lua_pushcfunction(L, thread_spawn);
+    lua_setfield(L, -2, "spawn");
+
+    return 1;
+}
+
+/**
+ * Create the thread metatable in the registry.
+ *
+ * [-0, +1, ?]
+ */
+static int create_thread_mt(lua_State *L) {
+
+    static luaL_Reg fns[] = {
+        { "stop",          thread_stop },
+        { "start",         thread_start },
+        { "join",          thread_join },
+        { "is_done",       thread_is_done },
+        { "__gc",          thread_gc },
+        { NULL, NULL }
+    };
+    luaL_newmetatable(L, THREAD_MT);
+    add_watcher_mt(L);
+    luaL_setfuncs(L, fns, 0);
+
+    return 1;
+}
+
+/**
+ * Returns true if L was created by ev.Thread.spawn().  Such states
+ * must not use the libev default loop since it belongs to the main
+ * thread, so check_loop_and_init() gives them a loop of their own.
+ *
+ * [-0, +0, -]
+ */
+static int thread_is_spawned(lua_State *L) {
+    int is_spawned;
+
+    lua_pushlightuserdata(L, &thread_registry);
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    is_spawned = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+
+    return is_spawned;
+}
+
+/**
+ * Copies the value at from_i in from onto the stack of to.  Only nil,
+ * booleans, numbers, strings and tables of those can be copied.
+ * Returns 0 (and pushes nothing) if the value can not be copied.
+ *
+ * [-0, +(0|1), m]
+ */
+static int thread_copy(lua_State* from, int from_i, lua_State* to, int depth) {
+    size_t      len;
+    const char* str;
+
+    from_i = lua_absindex(from, from_i);
+    if ( ! lua_checkstack(to, 3) || ! lua_checkstack(from, 2) ) return 0;
+
+    switch ( lua_type(from, from_i) ) {
+    case LUA_TNIL:
+        lua_pushnil(to);
+        return 1;
+    case LUA_TBOOLEAN:
+        lua_pushboolean(to, lua_toboolean(from, from_i));
+        return 1;
+    case LUA_TNUMBER:
+#if LUA_VERSION_NUM > 502
+        if ( lua_isinteger(from, from_i) ) {
+            lua_pushinteger(to, lua_tointeger(from, from_i));
+            return 1;
+        }
+#endif
+        lua_pushnumber(to, lua_tonumber(from, from_i));
+        return 1;
+    case LUA_TSTRING:
+        str = lua_tolstring(from, from_i, &len);
+        lua_pushlstring(to, str, len);
+        return 1;
+    case LUA_TTABLE:
+        if ( depth >= THREAD_COPY_DEPTH ) return 0;
+        lua_newtable(to);
+        lua_pushnil(from);
+        while ( lua_next(from, from_i) != 0 ) {
+            if ( ! thread_copy(from, -2, to, depth + 1) ) {
+                lua_pop(from, 2);
+                lua_pop(to, 1);
+                return 0;
+            }
+            if ( ! thread_copy(from, -1, to, depth + 1) ) {
+                lua_pop(from, 2);
+                lua_pop(to, 2);
+                return 0;
+            }
+            lua_rawset(to, -3);
+            lua_pop(from, 1);
+        }
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Drops one reference to the state shared by a thread handle and the
+ * running thread, and frees it when it was the last one.
+ *
+ * [-0, +0, -]
+ */
+static void thread_release(evlua_thread_shared* shared) {
+    int last;
+
+    pthread_mutex_lock(&shared->lock);
+    last = ( 0 == --shared->refs );
+    pthread_mutex_unlock(&shared->lock);
+
+    if ( ! last ) return;
+
+    lua_close(shared->L);
+    pthread_mutex_destroy(&shared->lock);
+    free(shared);
+}
+
+/**
+ * Runs in the new lua_State:
+ *   1 - chunk function or module name
+ *   2.. - arguments
+ *
+ * A module is require()d, and if it returns a function that is called
+ * with the arguments.  Afterwards the default loop of the thread is run
+ * until it has no more watchers.  Returns the result of the chunk (or
+ * module function).
+ *
+ * [-0, +1, e]
+ */
+static int thread_run(lua_State *L) {
+    int nargs = lua_gettop(L) - 1;
+
+    if ( lua_type(L, 1) == LUA_TSTRING ) {
+        lua_getglobal(L, "require");
+        lua_pushvalue(L, 1);
+        lua_call(L, 1, 1);
+        lua_replace(L, 1);
+        if ( ! lua_isfunction(L, 1) ) lua_settop(L, nargs = 1);
+    }
+    if ( lua_isfunction(L, 1) ) lua_call(L, nargs, 1);
+
+    lua_getglobal(L, "require");
+    lua_pushliteral(L, "ev");
+    lua_call(L, 1, 1);
+    lua_getfield(L, -1, "Loop");
+    lua_getfield(L, -1, "default");
+    lua_getfield(L, -1, "loop");
+    lua_insert(L, -2);
+    lua_call(L, 1, 0);
+    lua_pop(L, 2);
+
+    return 1;
+}
+
+/**
+ * The pthread start routine.  The stack of the new state holds
+ * traceback, thread_run and the arguments for thread_run.
+ */
+static void* thread_main(void* arg) {
+    evlua_thread_shared* shared = (evlua_thread_shared*)arg;
+    lua_State*           L      = shared->L;
+    int                  status;
+
+    status = lua_pcall(L, lua_gettop(L) - 2, 1, 1);
+
+    pthread_mutex_lock(&shared->lock);
+    shared->status = status;
+    shared->done   = 1;
+    if ( NULL != shared->notify ) ev_async_send(shared->notify, shared->async);
+    pthread_mutex_unlock(&shared->lock);
+
+    thread_release(shared);
+    return NULL;
+}
+
+/**
+ * Run a chunk of lua code (or a module) in a new OS thread with its
+ * own lua_State and event loop.  ev.Loop.default in the new state is a
+ * loop of its own (not the libev default loop), which is run after
+ * the chunk returns until it has no more watchers.  The elements of
+ * args are copied into the new state and passed to the chunk.
+ * Arguments:
+ *   1 - lua source code, or the name of a module.
+ *   2 - args (optional array of nil, booleans, numbers, strings or
+ *       tables of those).
+ *   3 - on_exit callback (optional), see thread_start().
+ *
+ * Usage:
+ *     thread = ev.Thread.spawn(chunk_or_module [, args [, on_exit]])
+ *
+ * [-0, +1, e]
+ */
+static int thread_spawn(lua_State *L) {
+    size_t               len;
+    const char*          chunk = luaL_checklstring(L, 1, &len);
+    evlua_thread_shared* shared;
+    evlua_thread*        thread;
+    lua_State*           T;
+    int                  nargs = 0;
+    int                  i;
+    int                  err;
+
+    if ( ! lua_isnoneornil(L, 2) ) {
+        luaL_checktype(L, 2, LUA_TTABLE);
+        nargs = (int)lua_rawlen(L, 2);
+    }
+    if ( ! lua_isnoneornil(L, 3) ) luaL_checktype(L, 3, LUA_TFUNCTION);
+
+    T = luaL_newstate();
+    if ( NULL == T ) return luaL_error(L, "unable to create a lua state");
+    luaL_openlibs(T);
+
+    lua_pushlightuserdata(T, &thread_registry);
+    lua_pushboolean(T, 1);
+    lua_rawset(T, LUA_REGISTRYINDEX);
+
+    /* package.preload.ev = luaopen_ev */
+    lua_getglobal(T, "package");
+    lua_getfield(T, -1, "preload");
+    lua_pushcfunction(T, luaopen_ev);
+    lua_setfield(T, -2, "ev");
+    lua_pop(T, 2);
+
+    lua_pushcfunction(T, traceback);
+    lua_pushcfunction(T, thread_run);
+
+    if ( len == strspn(chunk, THREAD_MODULE_CHARS) ) {
+        lua_pushlstring(T, chunk, len);
+    } else if ( luaL_loadbuffer(T, chunk, len, "=ev.Thread") ) {
+        lua_pushstring(L, lua_tostring(T, -1));
+        lua_close(T);
+        return lua_error(L);
+    }
+
+    if ( ! lua_checkstack(T, nargs) ) {
+        lua_close(T);
+        return luaL_error(L, "too many arguments");
+    }
+    for ( i = 1; i <= nargs; i++ ) {
+        lua_rawgeti(L, 2, i);
+        if ( ! thread_copy(L, -1, T, 0) ) {
+            lua_close(T);
+            return luaL_error(L, "unable to copy argument %d (a %s) to the thread",
+                              i, luaL_typename(L, -1));
+        }
+        lua_pop(L, 1);
+    }
+
+    shared = (evlua_thread_shared*)malloc(sizeof(evlua_thread_shared));
+    if ( NULL == shared ) {
+        lua_close(T);
+        return luaL_error(L, "out of memory");
+    }
+    pthread_mutex_init(&shared->lock, NULL);
+    shared->L      = T;
+    shared->refs   = 2;
+    shared->done   = 0;
+    shared->status = 0;
+    shared->notify = NULL;
+    shared->async  = NULL;
+
+    /* watcher_new() expects the callback as the first argument: */
+    lua_settop(L, 3);
+    if ( lua_isnil(L, 3) ) {
+        lua_pop(L, 1);
+        lua_pushcfunction(L, thread_noop);
+    }
+    lua_insert(L, 1);
+
+    thread = watcher_new(L, sizeof(evlua_thread), THREAD_MT, OBJ_THREAD);
+    ev_async_init(&thread->async, &thread_cb);
+    thread->shared = shared;
+    thread->joined = 0;
+
+    err = pthread_create(&shared->tid, NULL, &thread_main, shared);
+    if ( err ) {
+        thread->shared = NULL;
+        lua_close(T);
+        pthread_mutex_destroy(&shared->lock);
+        free(shared);
+        return luaL_error(L, "unable to create thread: %s", strerror(err));
+    }
+
+    return 1;
+}
+
+/**
+ * Default on_exit callback.
+ *
+ * [-0, +0, -]
+ */
+static int thread_noop(lua_State *L) {
+    return 0;
+}
+
+/**
+ * Waits for the thread to finish (if it has not already) and pushes
+ * true and the result of the chunk, or false and the error message.
+ * Results that can not be copied come back as nil.
+ *
+ * [-0, +2, e]
+ */
+static void thread_push_result(lua_State *L, evlua_thread* thread) {
+    evlua_thread_shared* shared = thread->shared;
+
+    if ( ! thread->joined ) {
+        pthread_join(shared->tid, NULL);
+        thread->joined = 1;
+    }
+
+    lua_pushboolean(L, 0 == shared->status);
+    if ( ! thread_copy(shared->L, -1, L, 0) ) lua_pushnil(L);
+}
+
+/**
+ * The thread finished, called through the ev_async.  Calls:
+ *
+ *     on_exit(loop, thread, revents, ok, result_or_error)
+ *
+ * [+0, -0, m]
+ */
+static void thread_cb(struct ev_loop* loop, ev_async* async, int revents) {
+    evlua_thread* thread = (evlua_thread*)async;
+    lua_State*    L      = ev_userdata(loop);
+    int           done;
+
+    pthread_mutex_lock(&thread->shared->lock);
+    done = thread->shared->done;
+    pthread_mutex_unlock(&thread->shared->lock);
+    if ( ! done ) return;
+
+    /* watcher_cb() unregisters the handle once it is stopped: */
+    ev_async_stop(loop, async);
+    thread_push_result(L, thread);
+    watcher_cb_args(loop, thread, revents, 2);
+}
+
+/**
+ * Blocks until the thread finished.  Returns true and the result of
+ * the chunk, or false and the error message.
+ *
+ * Usage:
+ *     ok, result = thread:join()
+ *
+ * [+2, -0, e]
+ */
+static int thread_join(lua_State *L) {
+    evlua_thread* thread = check_thread(L, 1);
+
+    thread_push_result(L, thread);
+    return 2;
+}
+
+/**
+ * Returns true if the thread finished.
+ *
+ * Usage:
+ *     bool = thread:is_done()
+ *
+ * [+1, -0, e]
+ */
+static int thread_is_done(lua_State *L) {
+    evlua_thread* thread = check_thread(L, 1);
+    int           done;
+
+    pthread_mutex_lock(&thread->shared->lock);
+    done = thread->shared->done;
+    pthread_mutex_unlock(&thread->shared->lock);
+
+    lua_pushboolean(L, done);
+    return 1;
+}
+
+/**
+ * Stops the thread handle so on_exit won't be called by the specified
+ * event loop.  The thread keeps running.
+ *
+ * Usage:
+ *     thread:stop(loop)
+ *
+ * [+0, -0, e]
+ */
+static int thread_stop(lua_State *L) {
+    evlua_thread*   thread = check_thread(L, 1);
+    struct ev_loop* loop   = *check_loop_and_init(L, 2);
+
+    pthread_mutex_lock(&thread->shared->lock);
+    thread->shared->notify = NULL;
+    pthread_mutex_unlock(&thread->shared->lock);
+
+    loop_stop_watcher(L, 1);
+    ev_async_stop(loop, &thread->async);
+
+    return 0;
+}
+
+/**
+ * Starts the thread handle so on_exit is called by the specified
+ * event loop once the thread finished (right away if it already did).
+ *
+ * Usage:
+ *     thread:start(loop [, is_daemon])
+ *
+ * [+0, -0, e]
+ */
+static int thread_start(lua_State *L) {
+    evlua_thread*   thread    = check_thread(L, 1);
+    struct ev_loop* loop      = *check_loop_and_init(L, 2);
+    int             is_daemon = lua_toboolean(L, 3);
+
+    ev_async_start(loop, &thread->async);
+    loop_start_watcher(L, 2, 1, is_daemon);
+
+    pthread_mutex_lock(&thread->shared->lock);
+    thread->shared->notify = loop;
+    thread->shared->async  = &thread->async;
+    if ( thread->shared->done ) ev_async_send(loop, &thread->async);
+    pthread_mutex_unlock(&thread->shared->lock);
+
+    return 0;
+}
+
+/**
+ * Called by loop_delete() for a started thread handle so the running
+ * thread never signals a destroyed loop (or a collected handle).
+ *
+ * [-0, +0, -]
+ */
+static void thread_forget_loop(lua_State *L, int thread_i, struct ev_loop* loop) {
+    evlua_thread* thread = (evlua_thread*)lua_touserdata(L, thread_i);
+
+    /* thread_gc() may already have ran if lua_close() is collecting: */
+    if ( NULL != thread->shared ) {
+        pthread_mutex_lock(&thread->shared->lock);
+        thread->shared->notify = NULL;
+        pthread_mutex_unlock(&thread->shared->lock);
+    }
+    ev_async_stop(loop, &thread->async);
+}
+
+/**
+ * Lets a still running thread finish on its own once the handle is
+ * garbage collected.
+ *
+ * [+0, -0, -]
+ */
+static int thread_gc(lua_State *L) {
+    evlua_thread* thread = check_thread(L, 1);
+
+    if ( NULL == thread->shared ) return 0;
+
+    if ( ! thread->joined ) pthread_detach(thread->shared->tid);
+
+    pthread_mutex_lock(&thread->shared->lock);
+    thread->shared->notify = NULL;
+    pthread_mutex_unlock(&thread->shared->lock);
+
+    thread_release(thread->shared);
+    thread->shared = NULL;
+    return 0;
+}
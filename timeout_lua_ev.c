@@ -0,0 +1,167 @@
+/**
+ * Create a table for ev.Timeout that gives access to the constructor
+ * for timeout objects.
+ *
+ * [-0, +1, ?]
+ */
+static int luaopen_ev_timeout(lua_State *L) {
+    lua_pop(L, create_timeout_mt(L));
+
+    lua_createtable(L, 0, 1);
+
+    lua_pushcfunction(L, timeout_new);
+    lua_setfield(L, -2, "new");
+
+    return 1;
+}
+
+/**
+ * Create the timeout metatable in the registry.
+ *
+ * [-0, +1, ?]
+ */
+static int create_timeout_mt(lua_State *L) {
+
+    static luaL_Reg fns[] = {
+        { "stop",          timeout_stop },
+        { "start",         timeout_start },
+        { "touch",         timeout_touch },
+        { "remaining",     timeout_remaining },
+        { NULL, NULL }
+    };
+    luaL_newmetatable(L, TIMEOUT_MT);
+    add_watcher_mt(L);
+    luaL_setfuncs(L, fns, 0);
+
+    return 1;
+}
+
+/**
+ * Create a new timeout object.  Arguments:
+ *   1 - callback function.
+ *   2 - timeout (number of seconds without activity)
+ *
+ * @see watcher_new()
+ *
+ * [+1, -0, ?]
+ */
+static int timeout_new(lua_State* L) {
+    ev_tstamp      after = luaL_checknumber(L, 2);
+    evlua_timeout* timeout;
+
+    if ( after <= 0.0 )
+        luaL_argerror(L, 2, "timeout must be greater than 0");
+
+    timeout = watcher_new(L, sizeof(evlua_timeout), TIMEOUT_MT, OBJ_TIMEOUT);
+    ev_timer_init(&timeout->timer, &timeout_cb, after, 0);
+    timeout->timeout = after;
+    timeout->last    = 0;
+    return 1;
+}
+
+/**
+ * This is the "last activity" pattern from the libev documentation:
+ * touch() only records the time, and when the timer expires it is
+ * restarted for the remaining time if there was activity since it
+ * was started.  The lua callback is only called once the timeout
+ * really passed.
+ *
+ * @see watcher_cb()
+ *
+ * [+0, -0, m]
+ */
+static void timeout_cb(struct ev_loop* loop, ev_timer* timer, int revents) {
+    evlua_timeout* timeout = (evlua_timeout*)timer;
+    ev_tstamp      after   = timeout->last + timeout->timeout - ev_now(loop);
+
+    if ( after > 0 ) {
+        ev_timer_set(timer, after, 0);
+        ev_timer_start(loop, timer);
+        return;
+    }
+    watcher_cb(loop, timer, revents);
+}
+
+/**
+ * Records activity, pushing the timeout back by its full length.  This
+ * is a single store, so it is cheap enough to call for every packet.
+ * Does nothing if the timeout is not started.
+ *
+ * Usage:
+ *     timeout:touch()
+ *
+ * [+0, -0, e]
+ */
+static int timeout_touch(lua_State *L) {
+    evlua_timeout* timeout = check_timeout(L, 1);
+    evlua_watcher* ext     = WATCHER_EXT(timeout);
+
+    if ( NULL != ext->loop ) timeout->last = ev_now(ext->loop->loop);
+
+    return 0;
+}
+
+/**
+ * Returns the number of seconds left until the timeout, or nil if it
+ * is not started.
+ *
+ * Usage:
+ *     seconds = timeout:remaining()
+ *
+ * [+1, -0, e]
+ */
+static int timeout_remaining(lua_State *L) {
+    evlua_timeout* timeout = check_timeout(L, 1);
+    evlua_watcher* ext     = WATCHER_EXT(timeout);
+    ev_tstamp      after;
+
+    if ( NULL == ext->loop || ! ev_is_active(&timeout->timer) ) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    after = timeout->last + timeout->timeout - ev_now(ext->loop->loop);
+    lua_pushnumber(L, after > 0 ? after : 0);
+    return 1;
+}
+
+/**
+ * Stops the timeout so it won't be called by the specified event loop.
+ *
+ * Usage:
+ *     timeout:stop(loop)
+ *
+ * [+0, -0, e]
+ */
+static int timeout_stop(lua_State *L) {
+    evlua_timeout*  timeout = check_timeout(L, 1);
+    struct ev_loop* loop    = *check_loop_and_init(L, 2);
+
+    loop_stop_watcher(L, 1);
+    ev_timer_stop(loop, &timeout->timer);
+
+    return 0;
+}
+
+/**
+ * Starts the timeout counting from now in the specified event loop.
+ * Starting an already started timeout restarts it.
+ *
+ * Usage:
+ *     timeout:start(loop [, is_daemon])
+ *
+ * [+0, -0, e]
+ */
+static int timeout_start(lua_State *L) {
+    evlua_timeout*  timeout   = check_timeout(L, 1);
+    struct ev_loop* loop      = *check_loop_and_init(L, 2);
+    int             is_daemon = lua_toboolean(L, 3);
+
+    ev_timer_stop(loop, &timeout->timer);
+    timeout->last = ev_now(loop);
+    ev_timer_set(&timeout->timer, timeout->timeout, 0);
+    ev_timer_start(loop, &timeout->timer);
+    loop_start_watcher(L, 2, 1, is_daemon);
+
+    return 0;
+}
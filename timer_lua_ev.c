@@ -7,11 +7,14 @@
 static int luaopen_ev_timer(lua_State *L) {
     lua_pop(L, create_timer_mt(L));
 
-    lua_createtable(L, 0, 1);
+    lua_createtable(L, 0, 2);
 
     lua_pushcfunction(L, timer_new);
     lua_setfield(L, -2, "new");
 
+    lua_pushcfunction(L, timer_pool);
+    lua_setfield(L, -2, "pool");
+
     return 1;
 }
 
@@ -54,17 +57,43 @@ static int timer_new(lua_State* L) {
     if ( repeat < 0.0 )
         luaL_argerror(L, 3, "repeat must be greater than or equal to 0");
 
-    timer = watcher_new(L, sizeof(ev_timer), TIMER_MT);
+    timer = watcher_new(L, sizeof(ev_timer), TIMER_MT, OBJ_TIMER);
     ev_timer_init(timer, &timer_cb, after, repeat);
     return 1;
 }
 
 /**
+ * Create a pool of timer watchers, see pool_acquire().  Arguments:
+ *   1 - max (most released watchers kept for reuse, default 64).
+ *
+ * Usage:
+ *   pool = ev.Timer.pool([max])
+ *
+ * [+1, -0, e]
+ */
+static int timer_pool(lua_State* L) {
+    return pool_new(L, OBJ_TIMER);
+}
+
+/**
+ * Records how late the timer fired before calling the lua callback,
+ * if the loop is measuring latency (see loop_latency()).
+ * Once a timer expired libev keeps its deadline relative to the time
+ * it was processed, so the remaining time is minus the lateness, less
+ * the repeat for repeating timers which are already rescheduled.
+ *
  * @see watcher_cb()
  *
  * [+0, -0, m]
  */
 static void timer_cb(struct ev_loop* loop, ev_timer* timer, int revents) {
+    evlua_loop* lp = WATCHER_EXT(timer)->loop;
+
+    if ( lp->latency ) {
+        latency_record(&lp->timer_late,
+                       ( ev_is_active(timer) ? timer->repeat : 0 ) -
+                       ev_timer_remaining(loop, timer));
+    }
     watcher_cb(loop, timer, revents);
 }
 
@@ -98,7 +127,7 @@ static int timer_again(lua_State *L) {
     } else {
         /* Just calling stop instead of again in case the symantics
          * change in libev */
-        loop_stop_watcher(L, 2, 1);
+        loop_stop_watcher(L, 1);
         ev_timer_stop(loop, timer);
     }
 
@@ -117,7 +146,7 @@ static int timer_stop(lua_State *L) {
     ev_timer*       timer  = check_timer(L, 1);
     struct ev_loop* loop   = *check_loop_and_init(L, 2);
 
-    loop_stop_watcher(L, 2, 1);
+    loop_stop_watcher(L, 1);
     ev_timer_stop(loop, timer);
 
     return 0;
@@ -159,7 +188,7 @@ static int timer_clear_pending(lua_State *L) {
     if ( ! timer->repeat           &&
          ( revents & EV_TIMEOUT ) )
     {
-        loop_stop_watcher(L, 2, 1);
+        loop_stop_watcher(L, 1);
     }
 
     lua_pushnumber(L, revents);
@@ -0,0 +1,376 @@
+/**
+ * Create a table for ev.TimerWheel that gives access to the
+ * constructor for timer wheel objects.
+ *
+ * [-0, +1, ?]
+ */
+static int luaopen_ev_timer_wheel(lua_State *L) {
+    lua_pop(L, create_timer_wheel_mt(L));
+
+    lua_createtable(L, 0, 1);
+
+    lua_pushcfunction(L, timer_wheel_new);
+    lua_setfield(L, -2, "new");
+
+    return 1;
+}
+
+/**
+ * Create the timer wheel metatable in the registry.
+ *
+ * [-0, +1, ?]
+ */
+static int create_timer_wheel_mt(lua_State *L) {
+
+    static luaL_Reg fns[] = {
+        { "add",           timer_wheel_add },
+        { "reset",         timer_wheel_reset },
+        { "cancel",        timer_wheel_cancel },
+        { "count",         timer_wheel_count },
+        { NULL, NULL }
+    };
+    luaL_newmetatable(L, TIMER_WHEEL_MT);
+    add_watcher_mt(L);
+    luaL_setfuncs(L, fns, 0);
+
+    return 1;
+}
+
+/**
+ * Create a new timer wheel bound to a loop.  The wheel has slots
+ * buckets, each covering tick seconds, and is driven by one internal
+ * timer that only runs while timeouts are pending.  Arguments:
+ *   1 - callback function.
+ *   2 - loop object.
+ *   3 - tick (seconds per slot)
+ *   4 - slots (number of slots)
+ *
+ * @see watcher_new()
+ *
+ * [+1, -0, ?]
+ */
+static int timer_wheel_new(lua_State* L) {
+    struct ev_loop*   loop  = *check_loop_and_init(L, 2);
+    ev_tstamp         tick  = luaL_checknumber(L, 3);
+#if LUA_VERSION_NUM > 502
+    lua_Integer       slots = luaL_checkinteger(L, 4);
+#else
+    lua_Integer       slots = luaL_checkint(L, 4);
+#endif
+    evlua_timer_wheel* wheel;
+    unsigned int      i;
+
+    luaL_argcheck(L, tick > 0, 3, "tick must be greater than 0");
+    luaL_argcheck(L, slots > 0 && slots <= TIMER_WHEEL_MAX_SLOTS, 4,
+                  "slots out of range");
+
+    wheel = watcher_new(L, sizeof(evlua_timer_wheel), TIMER_WHEEL_MT, OBJ_TIMER_WHEEL);
+    ev_timer_init(&wheel->timer, &timer_wheel_cb, tick, tick);
+    wheel->loop  = loop;
+    wheel->tick  = tick;
+    wheel->now   = 0;
+    wheel->slots = (unsigned int)slots;
+    wheel->size  = wheel->slots + 1 + TIMER_WHEEL_MIN_NODES;
+    wheel->used  = wheel->slots + 1;
+    wheel->free  = 0;
+    wheel->count = 0;
+
+    watcher_push_fenv(L, -1, 1);
+
+    lua_pushvalue(L, 2);
+    lua_rawseti(L, -2, WATCHER_WHEEL_LOOP);
+
+    wheel->nodes = (evlua_timer_wheel_node*)
+        lua_newuserdata(L, wheel->size * sizeof(evlua_timer_wheel_node));
+    lua_rawseti(L, -2, WATCHER_WHEEL_NODES);
+
+    lua_newtable(L);
+    lua_rawseti(L, -2, WATCHER_WHEEL_INDEX);
+
+    lua_newtable(L);
+    lua_rawseti(L, -2, WATCHER_WHEEL_KEYS);
+
+    lua_pop(L, 1);
+
+    /* Nodes 1 .. slots are the list heads of the slots: */
+    for ( i = 1; i <= wheel->slots; i++ ) {
+        wheel->nodes[i].next = i;
+        wheel->nodes[i].prev = i;
+    }
+
+    return 1;
+}
+
+/**
+ * Returns a free node, growing the node array (kept at WATCHER_WHEEL_NODES
+ * in the fenv at fenv_i) if needed.
+ *
+ * [-0, +0, m]
+ */
+static unsigned int timer_wheel_alloc(lua_State* L, evlua_timer_wheel* wheel, int fenv_i) {
+    evlua_timer_wheel_node* nodes;
+    unsigned int            i;
+
+    if ( wheel->free ) {
+        i = wheel->free;
+        wheel->free = wheel->nodes[i].next;
+        return i;
+    }
+    if ( wheel->used == wheel->size ) {
+        if ( wheel->size > TIMER_WHEEL_MAX_NODES / 2 ) {
+            luaL_error(L, "too many timeouts in timer wheel");
+        }
+        nodes = (evlua_timer_wheel_node*)
+            lua_newuserdata(L, 2 * wheel->size * sizeof(evlua_timer_wheel_node));
+        memcpy(nodes, wheel->nodes, wheel->size * sizeof(evlua_timer_wheel_node));
+        lua_rawseti(L, fenv_i, WATCHER_WHEEL_NODES);
+        wheel->nodes = nodes;
+        wheel->size *= 2;
+    }
+    return wheel->used++;
+}
+
+/**
+ * Puts node i into the slot it expires in.  The timeout is rounded up
+ * to whole ticks counted from the next tick, so it never fires early.
+ *
+ * [-0, +0, -]
+ */
+static void timer_wheel_link(evlua_timer_wheel* wheel, unsigned int i) {
+    evlua_timer_wheel_node* nodes = wheel->nodes;
+    ev_tstamp               next  = ev_is_active(&wheel->timer) ?
+        ev_timer_remaining(wheel->loop, &wheel->timer) : wheel->tick;
+    ev_tstamp               ticks = ceil((nodes[i].timeout - next) / wheel->tick) + 1;
+    unsigned int            head;
+
+    if ( ticks < 1 ) ticks = 1;
+    if ( ticks > UINT_MAX ) ticks = UINT_MAX;
+
+    head = (unsigned int)((wheel->now + (unsigned long)ticks) % wheel->slots) + 1;
+    nodes[i].rounds = ((unsigned int)ticks - 1) / wheel->slots;
+    nodes[i].next   = head;
+    nodes[i].prev   = nodes[head].prev;
+    nodes[nodes[head].prev].next = i;
+    nodes[head].prev = i;
+}
+
+/**
+ * Takes node i out of its slot.
+ *
+ * [-0, +0, -]
+ */
+static void timer_wheel_unlink(evlua_timer_wheel* wheel, unsigned int i) {
+    evlua_timer_wheel_node* nodes = wheel->nodes;
+
+    nodes[nodes[i].prev].next = nodes[i].next;
+    nodes[nodes[i].next].prev = nodes[i].prev;
+}
+
+/**
+ * Advances the wheel by one tick and calls the callback with a table
+ * of all the keys that expired in it:
+ *
+ *     callback(loop, wheel, revents, keys)
+ *
+ * The callback is not called for ticks where nothing expired.
+ *
+ * [+0, -0, m]
+ */
+static void timer_wheel_cb(struct ev_loop* loop, ev_timer* timer, int revents) {
+    lua_State*              L       = ev_userdata(loop);
+    evlua_timer_wheel*      wheel   = (evlua_timer_wheel*)timer;
+    evlua_timer_wheel_node* nodes   = wheel->nodes;
+    unsigned int            head    = (unsigned int)(++wheel->now % wheel->slots) + 1;
+    int                     expired = 0;
+    unsigned int            i, next;
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, WATCHER_EXT(wheel)->ref);
+    watcher_push_fenv(L, -1, 1);
+    lua_rawgeti(L, -1, WATCHER_WHEEL_INDEX);
+    lua_rawgeti(L, -2, WATCHER_WHEEL_KEYS);
+
+    /* STACK: <wheel>, <fenv>, <index>, <keys> */
+
+    for ( i = nodes[head].next; i != head; i = next ) {
+        next = nodes[i].next;
+        if ( nodes[i].rounds ) {
+            nodes[i].rounds--;
+            continue;
+        }
+        if ( ! expired ) lua_newtable(L);
+
+        timer_wheel_unlink(wheel, i);
+        nodes[i].next = wheel->free;
+        wheel->free   = i;
+        wheel->count--;
+
+        /* STACK: <wheel>, <fenv>, <index>, <keys>, <expired> */
+        lua_rawgeti(L, -2, i);
+        lua_pushnil(L);
+        lua_rawset(L, -5);
+        lua_rawgeti(L, -2, i);
+        lua_rawseti(L, -2, ++expired);
+        lua_pushnil(L);
+        lua_rawseti(L, -3, i);
+    }
+
+    if ( ! expired ) {
+        lua_pop(L, 4);
+        return;
+    }
+
+    lua_replace(L, -5);
+    lua_pop(L, 3);
+
+    /* watcher_cb() unregisters the wheel once the timer is stopped: */
+    if ( 0 == wheel->count ) ev_timer_stop(loop, timer);
+
+    watcher_cb_args(loop, wheel, revents, 1);
+}
+
+/**
+ * Adds a timeout for key, or restarts it with the new timeout if key
+ * is already in the wheel.  Keys can be any lua value except nil.
+ *
+ * Usage:
+ *     wheel:add(key, timeout)
+ *
+ * [+0, -0, e]
+ */
+static int timer_wheel_add(lua_State *L) {
+    evlua_timer_wheel* wheel   = check_timer_wheel(L, 1);
+    ev_tstamp          timeout = luaL_checknumber(L, 3);
+    unsigned int       i;
+
+    luaL_argcheck(L, ! lua_isnoneornil(L, 2), 2, "key must not be nil");
+    luaL_argcheck(L, timeout >= 0, 3, "timeout must be greater than or equal to 0");
+
+    lua_settop(L, 3);
+    watcher_push_fenv(L, 1, 1);
+    lua_rawgeti(L, 4, WATCHER_WHEEL_INDEX);
+    lua_pushvalue(L, 2);
+    lua_rawget(L, 5);
+
+    /* STACK: <wheel>, <key>, <timeout>, <fenv>, <index>, <node or nil> */
+
+    if ( lua_isnil(L, 6) ) {
+        i = timer_wheel_alloc(L, wheel, 4);
+
+        lua_pushvalue(L, 2);
+        lua_pushinteger(L, i);
+        lua_rawset(L, 5);
+
+        lua_rawgeti(L, 4, WATCHER_WHEEL_KEYS);
+        lua_pushvalue(L, 2);
+        lua_rawseti(L, -2, i);
+
+        if ( 0 == wheel->count++ ) {
+            ev_timer_set(&wheel->timer, wheel->tick, wheel->tick);
+            ev_timer_start(wheel->loop, &wheel->timer);
+            lua_rawgeti(L, 4, WATCHER_WHEEL_LOOP);
+            loop_start_watcher(L, -1, 1, 0);
+        }
+    } else {
+        i = (unsigned int)lua_tointeger(L, 6);
+        timer_wheel_unlink(wheel, i);
+    }
+
+    wheel->nodes[i].timeout = (float)timeout;
+    timer_wheel_link(wheel, i);
+
+    return 0;
+}
+
+/**
+ * Restarts the timeout of key with the timeout it was added with.
+ * Returns false if key is not in the wheel.
+ *
+ * Usage:
+ *     bool = wheel:reset(key)
+ *
+ * [+1, -0, e]
+ */
+static int timer_wheel_reset(lua_State *L) {
+    evlua_timer_wheel* wheel = check_timer_wheel(L, 1);
+    unsigned int       i;
+
+    lua_settop(L, 2);
+    watcher_push_fenv(L, 1, 1);
+    lua_rawgeti(L, 3, WATCHER_WHEEL_INDEX);
+    lua_pushvalue(L, 2);
+    lua_rawget(L, 4);
+
+    if ( lua_isnil(L, 5) ) {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+
+    i = (unsigned int)lua_tointeger(L, 5);
+    timer_wheel_unlink(wheel, i);
+    timer_wheel_link(wheel, i);
+
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+/**
+ * Removes the timeout of key.  Returns false if key is not in the
+ * wheel.
+ *
+ * Usage:
+ *     bool = wheel:cancel(key)
+ *
+ * [+1, -0, e]
+ */
+static int timer_wheel_cancel(lua_State *L) {
+    evlua_timer_wheel* wheel = check_timer_wheel(L, 1);
+    unsigned int       i;
+
+    lua_settop(L, 2);
+    watcher_push_fenv(L, 1, 1);
+    lua_rawgeti(L, 3, WATCHER_WHEEL_INDEX);
+    lua_pushvalue(L, 2);
+    lua_rawget(L, 4);
+
+    /* STACK: <wheel>, <key>, <fenv>, <index>, <node or nil> */
+
+    if ( lua_isnil(L, 5) ) {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+
+    i = (unsigned int)lua_tointeger(L, 5);
+    timer_wheel_unlink(wheel, i);
+    wheel->nodes[i].next = wheel->free;
+    wheel->free = i;
+
+    lua_pushvalue(L, 2);
+    lua_pushnil(L);
+    lua_rawset(L, 4);
+    lua_rawgeti(L, 3, WATCHER_WHEEL_KEYS);
+    lua_pushnil(L);
+    lua_rawseti(L, -2, i);
+
+    if ( 0 == --wheel->count ) {
+        loop_stop_watcher(L, 1);
+        ev_timer_stop(wheel->loop, &wheel->timer);
+    }
+
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+/**
+ * Returns the number of pending timeouts.
+ *
+ * Usage:
+ *     num = wheel:count()
+ *
+ * [+1, -0, e]
+ */
+static int timer_wheel_count(lua_State *L) {
+    evlua_timer_wheel* wheel = check_timer_wheel(L, 1);
+
+    lua_pushinteger(L, (lua_Integer)wheel->count);
+    return 1;
+}
@@ -17,6 +17,8 @@ static int add_watcher_mt(lua_State *L) {
         { "clear_pending", watcher_clear_pending },
         { "callback",      watcher_callback },
         { "priority",      watcher_priority },
+        { "stats",         watcher_stats },
+        { "bind",          watcher_bind },
         { "__index",       obj_index },
         { "__newindex",    obj_newindex },
         { NULL, NULL }
@@ -40,7 +42,14 @@ static int add_watcher_mt(lua_State *L) {
  * [-0, +0, ?]
  */
 static struct ev_watcher* check_watcher(lua_State *L, int watcher_i) {
-    void *watcher = lua_touserdata(L, watcher_i);
+    void *watcher;
+
+    /* Fast path, see obj_check(): */
+    if ( (obj_type(L, watcher_i) | 0xff) == (OBJ_WATCHER | 0xff) ) {
+        return (struct ev_watcher*)lua_touserdata(L, watcher_i);
+    }
+
+    watcher = lua_touserdata(L, watcher_i);
     if ( watcher != NULL ) { /* Got a userdata? */
         if ( lua_getmetatable(L, watcher_i) ) { /* got a metatable? */
             lua_getfield(L, -1, "is_watcher__");
@@ -99,82 +108,239 @@ static int watcher_clear_pending(lua_State *L) {
 /**
  * Implement the new function on all the watcher objects.  The first
  * element on the stack must be the callback function.  The new
- * "watcher" is now at the top of the stack.
+ * "watcher" is now at the top of the stack.  Room for an
+ * evlua_watcher is reserved after the size bytes of the libev
+ * watcher, and the watcher data field is pointed at it.  Note that
+ * the ev_TYPE_init() macros leave the data field untouched.
  *
  * [+1, -0, ?]
  */
-static void* watcher_new(lua_State* L, size_t size, const char* lua_type) {
-    void*  obj;
+static void* watcher_new(lua_State* L, size_t size, const char* lua_type, int type) {
+    void*          obj;
+    evlua_watcher* ext;
 
     luaL_checktype(L, 1, LUA_TFUNCTION);
 
-    obj = obj_new(L, size, lua_type);
+    obj = obj_new(L, WATCHER_EXT_OFFSET(size) + sizeof(evlua_watcher), lua_type, type);
     register_obj(L, -1, obj);
 
-    lua_getuservalue(L, -1);
+    ext = (evlua_watcher*)((char*)obj + WATCHER_EXT_OFFSET(size));
+    ext->ref  = LUA_NOREF;
+    ext->loop = NULL;
+    ((ev_watcher*)obj)->data = ext;
+
     lua_pushvalue(L, 1);
-    lua_rawseti(L, -2, WATCHER_FN);
+    watcher_set_fn(L, -2);
+
+    return obj;
+}
+
+/**
+ * Pushes the table holding the WATCHER_* slots of the watcher at
+ * watcher_i.  Compact watchers only get one when something is stored
+ * in it, so if create is false and there is none yet, nil is pushed
+ * and 0 is returned.
+ *
+ * [-0, +1, m]
+ */
+static int watcher_push_fenv(lua_State *L, int watcher_i, int create) {
+#if WATCHER_COMPACT
+    watcher_i = lua_absindex(L, watcher_i);
+    if ( LUA_TTABLE == lua_getiuservalue(L, watcher_i, 2) ) return 1;
+    if ( ! create ) return 0;
 
     lua_pop(L, 1);
+    lua_newtable(L);
+    lua_pushvalue(L, -1);
+    lua_setiuservalue(L, watcher_i, 2);
+#else
+    lua_getuservalue(L, watcher_i);
+#endif
+    return 1;
+}
 
-    return obj;
+/**
+ * Pushes the callback function of the watcher at watcher_i, or nil if
+ * it was removed.
+ *
+ * [-0, +1, -]
+ */
+static void watcher_push_fn(lua_State *L, int watcher_i) {
+#if WATCHER_COMPACT
+    lua_getiuservalue(L, watcher_i, 1);
+#else
+    lua_getuservalue(L, watcher_i);
+    lua_rawgeti(L, -1, WATCHER_FN);
+    lua_remove(L, -2);
+#endif
+}
+
+/**
+ * Pops the value at the top of the stack and makes it the callback
+ * function of the watcher at watcher_i.
+ *
+ * [-1, +0, m]
+ */
+static void watcher_set_fn(lua_State *L, int watcher_i) {
+#if WATCHER_COMPACT
+    lua_setiuservalue(L, lua_absindex(L, watcher_i), 1);
+#else
+    watcher_i = lua_absindex(L, watcher_i);
+    lua_getuservalue(L, watcher_i);
+    lua_insert(L, -2);
+    lua_rawseti(L, -2, WATCHER_FN);
+    lua_pop(L, 1);
+#endif
 }
 
 /**
  * Implements the callback function on all the watcher objects.  This
  * will be indirectly called by the libev event loop implementation.
- *
- * TODO: Custom error handlers?  Currently, any error in a callback
- * will print the error to stderr and things will "go on".
+ * The loop and watcher objects are found through the registry refs
+ * held in the evlua_loop and evlua_watcher, so no table lookups are
+ * needed.  Errors are handed to loop_callback_error().
  *
  * [+0, -0, m]
  */
 static void watcher_cb(struct ev_loop *loop, void *watcher, int revents) {
-    lua_State* L       = ev_userdata(loop);
-    void*      objs[3] = { loop, watcher, NULL };
-    int        result;
+    watcher_cb_args(loop, watcher, revents, 0);
+}
 
-    lua_pushcfunction(L, traceback);
+/**
+ * Same as watcher_cb(), but the top nargs values on the stack of the
+ * loop's lua_State are popped and passed to the callback function
+ * after the revents argument.  This lets watchers that do work on the
+ * C side (like ev.Reader) hand the result to lua in the same call.
+ *
+ * [-nargs, +0, m]
+ */
+static void watcher_cb_args(struct ev_loop *loop, void *watcher, int revents, int nargs) {
+    lua_State*           L     = ev_userdata(loop);
+    evlua_watcher*       ext   = WATCHER_EXT(watcher);
+    int                  base  = lua_gettop(L) - nargs;
+    evlua_watcher_stats* stats = NULL;
+    ev_tstamp            start = 0;
+    int                  result;
+    int                  i;
+
+    assert(LUA_NOREF != ext->ref /* loop_start_watcher() was called */);
 
-    result = lua_checkstack(L, 5);
+    result = lua_checkstack(L, 6 + nargs);
     assert(result != 0 /* able to allocate enough space on lua stack */);
-    result = push_objs(L, objs);
-    assert(result == 2 /* pushed two objects on the lua stack */);
-    assert(!lua_isnil(L, -2) /* the loop obj was resolved */);
-    assert(!lua_isnil(L, -1) /* the watcher obj was resolved */);
 
-    /* STACK: <traceback>, <loop>, <watcher> */
+    ext->loop->callbacks++;
+
+    loop_push(L, ext->loop);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ext->ref);
+
+    /* STACK: <args>, <loop>, <watcher> */
 
     if ( !ev_is_active(watcher) ) {
         /* Must remove "stop"ed watcher from loop: */
-        loop_stop_watcher(L, -2, -1);
+        loop_stop_watcher(L, -1);
     }
 
-    lua_getuservalue(L, -1);
-    assert(lua_istable(L, -1) /* The watcher fenv was found */);
-    lua_rawgeti(L, -1, WATCHER_FN);
+    watcher_push_fn(L, -1);
     if ( lua_isnil(L, -1) ) {
         /* The watcher function was set to nil, so do nothing */
-        lua_pop(L, 5);
+        lua_settop(L, base);
         return;
     }
     assert(lua_isfunction(L, -1) /* watcher function is a function */);
 
-    /* STACK: <traceback>, <loop>, <watcher>, <watcher fenv>, <watcher fn> */
+    /* STACK: <args>, <loop>, <watcher>, <watcher fn> */
 
-    lua_insert(L, -4);
-    lua_pop(L, 1);
+    if ( ((evlua_loop*)lua_touserdata(L, -3))->profile ) {
+        watcher_push_fenv(L, -2, 1);
+        lua_rawgeti(L, -1, WATCHER_STATS);
+        stats = (evlua_watcher_stats*)lua_touserdata(L, -1);
+        lua_pop(L, 1);
+        if ( NULL == stats ) {
+            stats = (evlua_watcher_stats*)
+                lua_newuserdata(L, sizeof(evlua_watcher_stats));
+            memset(stats, 0, sizeof(evlua_watcher_stats));
+            lua_rawseti(L, -2, WATCHER_STATS);
+        }
+        lua_pop(L, 1);
+        start = ev_time();
+    }
+
+    /* Keep the loop and watcher below the call for error handling: */
+    lua_pushvalue(L, -3);
+    lua_pushvalue(L, -3);
     lua_pushinteger(L, revents);
 
-    /* STACK: <traceback>, <watcher fn>, <loop>, <watcher>, <revents> */
-    if ( lua_pcall(L, 3, 0, -5) ) {
-        /* TODO: Enable user-specified error handler! */
-        fprintf(stderr, "CALLBACK FAILED: %s\n",
-                lua_tostring(L, -1));
-        lua_pop(L, 2);
+    /* Move the args above revents, preserving their order: */
+    for ( i = 0; i < nargs; i++ ) {
+        lua_pushvalue(L, base + 1);
+        lua_remove(L, base + 1);
+    }
+
+    /* STACK: <loop>, <watcher>, <watcher fn>, <loop>, <watcher>, <revents>, <args> */
+    result = lua_pcall(L, 3 + nargs, 0, 0);
+
+    if ( NULL != stats ) {
+        /* The watcher fenv keeps stats alive, the watcher is on the stack: */
+        ev_tstamp elapsed = ev_time() - start;
+
+        stats->calls++;
+        stats->total += elapsed;
+        if ( elapsed > stats->max ) stats->max = elapsed;
+        if ( result ) stats->errors++;
+    }
+
+    if ( result ) {
+        loop_callback_error(L);
     } else {
-        lua_pop(L, 1);
+        lua_pop(L, 2);
+    }
+}
+
+/**
+ * Pushes a table with the fields of stats.
+ *
+ * [-0, +1, m]
+ */
+static void watcher_push_stats(lua_State *L, evlua_watcher_stats* stats) {
+    lua_createtable(L, 0, 5);
+    lua_pushnumber(L, (lua_Number)stats->calls);
+    lua_setfield(L, -2, "calls");
+    lua_pushnumber(L, (lua_Number)stats->errors);
+    lua_setfield(L, -2, "errors");
+    lua_pushnumber(L, stats->total);
+    lua_setfield(L, -2, "total");
+    lua_pushnumber(L, stats->max);
+    lua_setfield(L, -2, "max");
+    lua_pushnumber(L, stats->calls ? stats->total / stats->calls : 0);
+    lua_setfield(L, -2, "avg");
+}
+
+/**
+ * Returns the profile of the watcher's callback, recorded while it
+ * was called by loops with profiling enabled, or nil if there is
+ * none.  Optionally resets it.
+ *
+ * Usage:
+ *   stats = watcher:stats([reset])
+ *
+ * [+1, -0, e]
+ */
+static int watcher_stats(lua_State *L) {
+    evlua_watcher_stats* stats;
+
+    check_watcher(L, 1);
+    if ( ! watcher_push_fenv(L, 1, 0) ) return 1;
+    lua_rawgeti(L, -1, WATCHER_STATS);
+    stats = (evlua_watcher_stats*)lua_touserdata(L, -1);
+    if ( NULL == stats ) {
+        lua_pushnil(L);
+        return 1;
     }
+
+    watcher_push_stats(L, stats);
+    if ( lua_toboolean(L, 2) ) memset(stats, 0, sizeof(evlua_watcher_stats));
+
+    return 1;
 }
 
 /**
@@ -193,14 +359,11 @@ static int watcher_callback(lua_State *L) {
     check_watcher(L, 1);
     if ( has_fn ) luaL_checktype(L, 2, LUA_TFUNCTION);
 
-    lua_getuservalue(L, 1);
-    assert(lua_istable(L, -1) /* getfenv of watcher worked */);
-    lua_rawgeti(L, -1, WATCHER_FN);
+    watcher_push_fn(L, 1);
     if ( has_fn ) {
         lua_pushvalue(L, 2);
-        lua_rawseti(L, -3, WATCHER_FN);
+        watcher_set_fn(L, 1);
     }
-    lua_remove(L, -2);
     return 1;
 }
 
@@ -227,3 +390,72 @@ static int watcher_priority(lua_State *L) {
     lua_pushinteger(L, old_pri);
     return 1;
 }
+
+/**
+ * Binds the watcher to a loop, so the loop argument of its methods
+ * (start, stop, again, ...) may be left out.  Binding nil removes the
+ * binding.  Returns the watcher so it can be chained to the
+ * constructor.
+ *
+ * Usage:
+ *   watcher = watcher:bind(loop)
+ *   timer   = ev.Timer.new(on_timeout, 1):bind(loop)
+ *
+ * [+1, -0, e]
+ */
+static int watcher_bind(lua_State *L) {
+    evlua_watcher* ext = WATCHER_EXT(check_watcher(L, 1));
+
+    if ( ! lua_isnoneornil(L, 2) ) {
+        check_loop(L, 2);
+        if ( NULL != ext->loop && lua_touserdata(L, 2) != (void*)ext->loop ) {
+            return luaL_error(L, "watcher is started in another loop");
+        }
+    }
+    lua_settop(L, 2);
+
+    watcher_push_fenv(L, 1, 1);
+    lua_pushvalue(L, 2);
+    lua_rawseti(L, -2, WATCHER_LOOP);
+
+    lua_pushvalue(L, 1);
+    return 1;
+}
+
+/**
+ * Called by check_loop_and_init() when the loop argument at loop_i is
+ * missing: if the first argument is a watcher bound to a loop, puts
+ * that loop at loop_i and returns true.  The loop was validated by
+ * watcher_bind().
+ *
+ * [-0, +0, -]
+ */
+static int watcher_bound_loop(lua_State *L, int loop_i) {
+    if ( 1 == loop_i || ! lua_isnoneornil(L, loop_i) ||
+         (obj_type(L, 1) | 0xff) != (OBJ_WATCHER | 0xff) )
+    {
+        return 0;
+    }
+
+    if ( ! watcher_push_fenv(L, 1, 0) ) {
+        lua_pop(L, 1);
+        return 0;
+    }
+    lua_rawgeti(L, -1, WATCHER_LOOP);
+    if ( lua_isnil(L, -1) ) {
+        lua_pop(L, 2);
+        return 0;
+    }
+    lua_replace(L, -2);
+
+    if ( lua_gettop(L) > loop_i ) {
+        lua_replace(L, loop_i);
+    } else {
+        /* Missing arguments, pad with nils: */
+        while ( lua_gettop(L) < loop_i ) {
+            lua_pushnil(L);
+            lua_insert(L, -2);
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,598 @@
+/**
+ * The process wide worker pool shared by all loops (and lua_States):
+ * requests are queued under work_lock and picked up by up to
+ * work_size threads which are started on demand.  Completed requests
+ * go back to their loop through a lock-free stack in the evlua_loop,
+ * see work_complete().  work_idle is signalled whenever the requests
+ * in flight for a loop drop to 0, see work_drain().  The threads are
+ * joined once the last lua_State that loaded the module closes, see
+ * work_gc(), so the module may be unloaded after that.
+ */
+static pthread_mutex_t  work_lock    = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   work_cond    = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t   work_idle    = PTHREAD_COND_INITIALIZER;
+static evlua_work_req*  work_head    = NULL;
+static evlua_work_req*  work_tail    = NULL;
+static pthread_t*       work_tids    = NULL;
+static int              work_size    = WORK_THREADS;
+static int              work_started = 0;
+static int              work_users   = 0;
+static int              work_stop    = 0;
+
+/**
+ * Create a table for ev.Work that gives access to the blocking
+ * operations that run in the worker pool.  Also counts this lua_State
+ * as a user of the pool, until its registry drops a sentinel whose
+ * __gc is work_gc().
+ *
+ * [-0, +1, ?]
+ */
+static int luaopen_ev_work(lua_State *L) {
+
+    static luaL_Reg fns[] = {
+        { "resolve",       work_resolve },
+        { "read_file",     work_read_file },
+        { "write_file",    work_write_file },
+        { "fsync",         work_fsync },
+        { "stat",          work_stat },
+        { "threads",       work_threads },
+        { NULL, NULL }
+    };
+    lua_newuserdata(L, 1);
+    luaL_newmetatable(L, WORK_MT);
+    lua_pushcfunction(L, work_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_setmetatable(L, -2);
+    luaL_ref(L, LUA_REGISTRYINDEX);
+
+    pthread_mutex_lock(&work_lock);
+    work_users++;
+    pthread_mutex_unlock(&work_lock);
+
+    lua_createtable(L, 0, 6);
+    luaL_setfuncs(L, fns, 0);
+
+    return 1;
+}
+
+/**
+ * A lua_State that loaded the module is closing.  If it was the last
+ * one, the workers are stopped and joined: the library may be
+ * unloaded right after this returns.  Every loop was deleted (and so
+ * drained) by now, so the queue is empty.
+ *
+ * [-0, +0, -]
+ */
+static int work_gc(lua_State *L) {
+    int i;
+    int count = 0;
+
+    pthread_mutex_lock(&work_lock);
+    if ( 0 == --work_users ) {
+        work_stop = 1;
+        count     = work_started;
+        pthread_cond_broadcast(&work_cond);
+    }
+    pthread_mutex_unlock(&work_lock);
+
+    if ( 0 == count ) return 0;
+
+    for ( i = 0; i < count; i++ ) pthread_join(work_tids[i], NULL);
+
+    pthread_mutex_lock(&work_lock);
+    free(work_tids);
+    work_tids    = NULL;
+    work_started = 0;
+    work_stop    = 0;
+    pthread_mutex_unlock(&work_lock);
+
+    return 0;
+}
+
+/**
+ * Validates the callback and loop arguments and allocates a request
+ * for op.  The callback and the remaining arguments are kept in a
+ * table referenced by the request, which also keeps any strings the
+ * worker reads alive.  Arguments:
+ *   1 - callback function.
+ *   2 - loop object.
+ *   3.. - arguments of op (already validated by the caller).
+ *
+ * [-0, +0, e]
+ */
+static evlua_work_req* work_new(lua_State *L, int op) {
+    evlua_work_req* req;
+    int             top = lua_gettop(L);
+    int             i;
+
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+    check_loop_and_init(L, 2);
+
+    req = (evlua_work_req*)malloc(sizeof(evlua_work_req));
+    if ( NULL == req ) {
+        luaL_error(L, "out of memory");
+        return NULL;
+    }
+    memset(req, 0, sizeof(evlua_work_req));
+    req->lp = check_evlua_loop(L, 2);
+    req->op = op;
+    req->fd = -1;
+
+    lua_createtable(L, top - 1, 0);
+    lua_pushvalue(L, 1);
+    lua_rawseti(L, -2, 1);
+    for ( i = 3; i <= top; i++ ) {
+        lua_pushvalue(L, i);
+        lua_rawseti(L, -2, i - 1);
+    }
+    req->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    return req;
+}
+
+/**
+ * Hands a request to the worker pool.  While requests are pending the
+ * loop's work async is started, which keeps both the event loop
+ * running and (through work_ref) the loop object alive.  The workers
+ * are joinable, work_gc() stops them.
+ *
+ * [-0, +0, -]
+ */
+static void work_submit(lua_State *L, evlua_work_req* req) {
+    evlua_loop* lp = req->lp;
+    pthread_t*  tids;
+
+    if ( 0 == lp->work_pending++ ) {
+        ev_async_start(lp->loop, &lp->work);
+        lua_pushvalue(L, 2);
+        lp->work_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+
+    pthread_mutex_lock(&work_lock);
+    lp->work_inflight++;
+    while ( work_started < work_size && ! work_stop ) {
+        tids = (pthread_t*)realloc(work_tids, (work_started + 1) * sizeof(pthread_t));
+        if ( NULL == tids ) break;
+        work_tids = tids;
+        if ( 0 != pthread_create(&work_tids[work_started], NULL, &work_main, NULL) ) break;
+        work_started++;
+    }
+    if ( 0 == work_started || work_stop ) {
+        /* No threads to be had, do it here rather than never: */
+        pthread_mutex_unlock(&work_lock);
+        work_run(req);
+        work_complete(req);
+        return;
+    }
+    if ( NULL == work_tail ) {
+        work_head = req;
+    } else {
+        work_tail->next = req;
+    }
+    work_tail = req;
+    pthread_cond_signal(&work_cond);
+    pthread_mutex_unlock(&work_lock);
+}
+
+/**
+ * The worker thread start routine.  Returns once work_stop is set and
+ * the queue is empty.
+ */
+static void* work_main(void* arg) {
+    evlua_work_req* req;
+
+    for ( ;; ) {
+        pthread_mutex_lock(&work_lock);
+        while ( NULL == work_head && ! work_stop ) {
+            pthread_cond_wait(&work_cond, &work_lock);
+        }
+        if ( NULL == work_head ) {
+            pthread_mutex_unlock(&work_lock);
+            break;
+        }
+        req = work_head;
+        work_head = req->next;
+        if ( NULL == work_head ) work_tail = NULL;
+        pthread_mutex_unlock(&work_lock);
+
+        req->next = NULL;
+        work_run(req);
+        work_complete(req);
+    }
+    return NULL;
+}
+
+/**
+ * Does the blocking part of a request.  Runs in a worker thread, so it
+ * must not touch any lua_State.
+ */
+static void work_run(evlua_work_req* req) {
+    struct addrinfo hints;
+    size_t          cap;
+    ssize_t         got;
+    int             fd;
+
+    switch ( req->op ) {
+    case WORK_RESOLVE:
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family   = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        req->err = getaddrinfo(req->str1, req->str2, &hints, &req->ai);
+        break;
+    case WORK_READ_FILE:
+        fd = open(req->str1, O_RDONLY);
+        if ( fd < 0 ) {
+            req->err = errno;
+            break;
+        }
+        cap = ( 0 == fstat(fd, &req->st) && req->st.st_size > 0 ) ?
+            (size_t)req->st.st_size + 1 : 4096;
+        req->buf = (char*)malloc(cap);
+        while ( NULL != req->buf ) {
+            if ( req->len == cap ) {
+                char* buf = (char*)realloc(req->buf, cap * 2);
+                if ( NULL == buf ) break;
+                req->buf = buf;
+                cap *= 2;
+            }
+            got = read(fd, req->buf + req->len, cap - req->len);
+            if ( got > 0 ) {
+                req->len += (size_t)got;
+            } else if ( got == 0 ) {
+                break;
+            } else if ( errno != EINTR ) {
+                req->err = errno;
+                break;
+            }
+        }
+        if ( NULL == req->buf ) req->err = ENOMEM;
+        close(fd);
+        break;
+    case WORK_WRITE_FILE:
+        fd = open(req->str1, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if ( fd < 0 ) {
+            req->err = errno;
+            break;
+        }
+        cap = req->len;
+        req->len = 0;
+        while ( req->len < cap ) {
+            got = write(fd, req->str2 + req->len, cap - req->len);
+            if ( got >= 0 ) {
+                req->len += (size_t)got;
+            } else if ( errno != EINTR ) {
+                req->err = errno;
+                break;
+            }
+        }
+        if ( 0 != close(fd) && 0 == req->err ) req->err = errno;
+        break;
+    case WORK_FSYNC:
+        if ( 0 != fsync(req->fd) ) req->err = errno;
+        break;
+    case WORK_STAT:
+        if ( 0 != stat(req->str1, &req->st) ) req->err = errno;
+        break;
+    }
+}
+
+/**
+ * Pushes a finished request onto the lock-free completion stack of
+ * its loop and wakes the loop up.  The loop may be freed as soon as
+ * work_inflight drops, so that has to come last.
+ */
+static void work_complete(evlua_work_req* req) {
+    evlua_loop* lp = req->lp;
+
+    req->next = __atomic_load_n(&lp->work_done, __ATOMIC_RELAXED);
+    while ( ! __atomic_compare_exchange_n(&lp->work_done, &req->next, req, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED) );
+    ev_async_send(lp->loop, &lp->work);
+
+    pthread_mutex_lock(&work_lock);
+    if ( 0 == --lp->work_inflight ) pthread_cond_broadcast(&work_idle);
+    pthread_mutex_unlock(&work_lock);
+}
+
+/**
+ * Frees a request and whatever its operation allocated.
+ */
+static void work_free(evlua_work_req* req) {
+    if ( NULL != req->ai ) freeaddrinfo(req->ai);
+    free(req->buf);
+    free(req);
+}
+
+/**
+ * Pushes the result of a request and the error message (nil on
+ * success, in which case the result is never nil).
+ *
+ * [-0, +2, m]
+ */
+static void work_push_result(lua_State *L, evlua_work_req* req) {
+    struct addrinfo* ai;
+    char             host[NI_MAXHOST];
+    int              i = 0;
+
+    if ( req->err ) {
+        lua_pushnil(L);
+        lua_pushstring(L, WORK_RESOLVE == req->op ?
+                       gai_strerror(req->err) : strerror(req->err));
+        return;
+    }
+
+    switch ( req->op ) {
+    case WORK_RESOLVE:
+        lua_newtable(L);
+        for ( ai = req->ai; NULL != ai; ai = ai->ai_next ) {
+            if ( 0 != getnameinfo(ai->ai_addr, ai->ai_addrlen, host, sizeof(host),
+                                  NULL, 0, NI_NUMERICHOST) ) continue;
+            lua_pushstring(L, host);
+            lua_rawseti(L, -2, ++i);
+        }
+        break;
+    case WORK_READ_FILE:
+        lua_pushlstring(L, req->buf, req->len);
+        break;
+    case WORK_WRITE_FILE:
+        lua_pushinteger(L, (lua_Integer)req->len);
+        break;
+    case WORK_FSYNC:
+        lua_pushboolean(L, 1);
+        break;
+    case WORK_STAT:
+        lua_createtable(L, 0, 10);
+        lua_pushnumber(L, (lua_Number)req->st.st_size);
+        lua_setfield(L, -2, "size");
+        lua_pushinteger(L, (lua_Integer)req->st.st_mode);
+        lua_setfield(L, -2, "mode");
+        lua_pushnumber(L, (lua_Number)req->st.st_mtime);
+        lua_setfield(L, -2, "mtime");
+        lua_pushnumber(L, (lua_Number)req->st.st_atime);
+        lua_setfield(L, -2, "atime");
+        lua_pushnumber(L, (lua_Number)req->st.st_ctime);
+        lua_setfield(L, -2, "ctime");
+        lua_pushinteger(L, (lua_Integer)req->st.st_nlink);
+        lua_setfield(L, -2, "nlink");
+        lua_pushinteger(L, (lua_Integer)req->st.st_uid);
+        lua_setfield(L, -2, "uid");
+        lua_pushinteger(L, (lua_Integer)req->st.st_gid);
+        lua_setfield(L, -2, "gid");
+        lua_pushboolean(L, S_ISDIR(req->st.st_mode));
+        lua_setfield(L, -2, "is_dir");
+        lua_pushboolean(L, S_ISREG(req->st.st_mode));
+        lua_setfield(L, -2, "is_file");
+        break;
+    }
+    lua_pushnil(L);
+}
+
+/**
+ * Delivers the requests that completed since the last call, oldest
+ * first, calling:
+ *
+ *     on_done(loop, result, err)
+ *
+ * for each.  Errors in on_done are handled like errors in watcher
+ * callbacks.
+ *
+ * [+0, -0, m]
+ */
+static void work_async_cb(struct ev_loop* loop, ev_async* async, int revents) {
+    evlua_loop*     lp   = (evlua_loop*)((char*)async - offsetof(evlua_loop, work));
+    lua_State*      L    = ev_userdata(loop);
+    evlua_work_req* list = __atomic_exchange_n(&lp->work_done, NULL, __ATOMIC_ACQUIRE);
+    evlua_work_req* fifo = NULL;
+    evlua_work_req* req;
+    int             result;
+
+    /* The stack is newest first: */
+    while ( NULL != list ) {
+        req        = list;
+        list       = req->next;
+        req->next  = fifo;
+        fifo       = req;
+    }
+
+    result = lua_checkstack(L, 7);
+    assert(result != 0 /* able to allocate enough space on lua stack */);
+
+    while ( NULL != (req = fifo) ) {
+        fifo = req->next;
+        lp->callbacks++;
+
+        /* Like watcher_cb(), the loop (and no watcher) stays below the call: */
+        lua_rawgeti(L, LUA_REGISTRYINDEX, lp->work_ref);
+        lua_pushnil(L);
+        lua_rawgeti(L, LUA_REGISTRYINDEX, req->ref);
+        lua_rawgeti(L, -1, 1);
+        lua_replace(L, -2);
+        lua_pushvalue(L, -3);
+        work_push_result(L, req);
+
+        luaL_unref(L, LUA_REGISTRYINDEX, req->ref);
+        work_free(req);
+
+        if ( 0 == --lp->work_pending ) {
+            ev_async_stop(loop, async);
+            luaL_unref(L, LUA_REGISTRYINDEX, lp->work_ref);
+            lp->work_ref = LUA_NOREF;
+        }
+
+        /* STACK: <loop>, nil, <on_done>, <loop>, <result>, <err> */
+        if ( lua_pcall(L, 3, 0, 0) ) {
+            loop_callback_error(L);
+        } else {
+            lua_pop(L, 2);
+        }
+    }
+}
+
+/**
+ * Called by loop_delete(): waits for the requests still running in
+ * the pool, since the workers write into the evlua_loop, and drops
+ * their results.
+ *
+ * [-0, +0, -]
+ */
+static void work_drain(evlua_loop* lp) {
+    evlua_work_req* req;
+
+    /* A worker pushes its result and wakes the loop before it leaves
+     * work_inflight, so the async may already be stopped while the
+     * worker still touches lp: */
+    pthread_mutex_lock(&work_lock);
+    while ( lp->work_inflight > 0 ) pthread_cond_wait(&work_idle, &work_lock);
+    pthread_mutex_unlock(&work_lock);
+    if ( ev_is_active(&lp->work) ) ev_async_stop(lp->loop, &lp->work);
+
+    while ( NULL != (req = lp->work_done) ) {
+        lp->work_done = req->next;
+        work_free(req);
+    }
+}
+
+/**
+ * Resolve a host name (and optionally a service) with getaddrinfo().
+ * The result is an array of numeric address strings.
+ *
+ * Usage:
+ *     ev.Work.resolve(on_done, loop, host [, service])
+ *
+ * [+0, -0, e]
+ */
+static int work_resolve(lua_State *L) {
+    evlua_work_req* req;
+
+    luaL_checkstring(L, 3);
+    if ( ! lua_isnoneornil(L, 4) ) luaL_checkstring(L, 4);
+    lua_settop(L, 4);
+
+    req = work_new(L, WORK_RESOLVE);
+    req->str1 = lua_tostring(L, 3);
+    req->str2 = lua_tostring(L, 4);
+    work_submit(L, req);
+
+    return 0;
+}
+
+/**
+ * Read a whole file.  The result is its content.
+ *
+ * Usage:
+ *     ev.Work.read_file(on_done, loop, path)
+ *
+ * [+0, -0, e]
+ */
+static int work_read_file(lua_State *L) {
+    evlua_work_req* req;
+
+    luaL_checkstring(L, 3);
+    lua_settop(L, 3);
+
+    req = work_new(L, WORK_READ_FILE);
+    req->str1 = lua_tostring(L, 3);
+    work_submit(L, req);
+
+    return 0;
+}
+
+/**
+ * Create or replace a file with data.  The result is the number of
+ * bytes written.
+ *
+ * Usage:
+ *     ev.Work.write_file(on_done, loop, path, data)
+ *
+ * [+0, -0, e]
+ */
+static int work_write_file(lua_State *L) {
+    evlua_work_req* req;
+    size_t          len;
+
+    luaL_checkstring(L, 3);
+    luaL_checklstring(L, 4, &len);
+    lua_settop(L, 4);
+
+    req = work_new(L, WORK_WRITE_FILE);
+    req->str1 = lua_tostring(L, 3);
+    req->str2 = lua_tostring(L, 4);
+    req->len  = len;
+    work_submit(L, req);
+
+    return 0;
+}
+
+/**
+ * Flush a file descriptor to disk.  The result is true.
+ *
+ * Usage:
+ *     ev.Work.fsync(on_done, loop, fd)
+ *
+ * [+0, -0, e]
+ */
+static int work_fsync(lua_State *L) {
+    evlua_work_req* req;
+#if LUA_VERSION_NUM > 502
+    int             fd = (int)luaL_checkinteger(L, 3);
+#else
+    int             fd = luaL_checkint(L, 3);
+#endif
+
+    lua_settop(L, 3);
+
+    req = work_new(L, WORK_FSYNC);
+    req->fd = fd;
+    work_submit(L, req);
+
+    return 0;
+}
+
+/**
+ * stat() a path.  The result is a table with size, mode, mtime,
+ * atime, ctime, nlink, uid, gid, is_dir and is_file.
+ *
+ * Usage:
+ *     ev.Work.stat(on_done, loop, path)
+ *
+ * [+0, -0, e]
+ */
+static int work_stat(lua_State *L) {
+    evlua_work_req* req;
+
+    luaL_checkstring(L, 3);
+    lua_settop(L, 3);
+
+    req = work_new(L, WORK_STAT);
+    req->str1 = lua_tostring(L, 3);
+    work_submit(L, req);
+
+    return 0;
+}
+
+/**
+ * Returns the size of the worker pool and optionally sets a new one.
+ * Threads are started as work is submitted and only stopped by
+ * work_gc(), so the pool can only grow while it is in use.
+ *
+ * Usage:
+ *     old_size = ev.Work.threads([new_size])
+ *
+ * [+1, -0, e]
+ */
+static int work_threads(lua_State *L) {
+    int old;
+#if LUA_VERSION_NUM > 502
+    int size = (int)luaL_optinteger(L, 1, 0);
+#else
+    int size = luaL_optint(L, 1, 0);
+#endif
+
+    pthread_mutex_lock(&work_lock);
+    old = work_size;
+    if ( size > 0 ) work_size = size;
+    pthread_mutex_unlock(&work_lock);
+
+    lua_pushinteger(L, old);
+    return 1;
+}
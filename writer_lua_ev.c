@@ -0,0 +1,390 @@
+/**
+ * Create a table for ev.Writer that gives access to the constructor for
+ * writer objects.
+ *
+ * [-0, +1, ?]
+ */
+static int luaopen_ev_writer(lua_State *L) {
+    lua_pop(L, create_writer_mt(L));
+
+    lua_createtable(L, 0, 1);
+
+    lua_pushcfunction(L, writer_new);
+    lua_setfield(L, -2, "new");
+
+    return 1;
+}
+
+/**
+ * Create the writer metatable in the registry.
+ *
+ * [-0, +1, ?]
+ */
+static int create_writer_mt(lua_State *L) {
+
+    static luaL_Reg fns[] = {
+        { "stop",          writer_stop },
+        { "start",         writer_start },
+        { "write",         writer_write },
+        { "cork",          writer_cork },
+        { "queued",        writer_queued },
+        { "getfd" ,        writer_getfd },
+        { NULL, NULL }
+    };
+    luaL_newmetatable(L, WRITER_MT);
+    add_watcher_mt(L);
+    luaL_setfuncs(L, fns, 0);
+
+    return 1;
+}
+
+/**
+ * Create a new writer object.  The fd is switched to non-blocking
+ * mode.  Arguments:
+ *   1 - callback function.
+ *   2 - fd (file descriptor number)
+ *   3 - high water mark in bytes (optional, default 64k)
+ *   4 - low water mark in bytes (optional, default high / 4)
+ *
+ * @see watcher_new()
+ *
+ * [+1, -0, ?]
+ */
+static int writer_new(lua_State* L) {
+#if LUA_VERSION_NUM > 502
+    int            fd    = (int)luaL_checkinteger(L, 2);
+#else
+    int            fd    = luaL_checkint(L, 2);
+#endif
+    lua_Integer    high  = luaL_optinteger(L, 3, WRITER_HIGH_WATER);
+    lua_Integer    low   = luaL_optinteger(L, 4, high / 4);
+    evlua_writer*  writer;
+    int            flags;
+    int            type;
+    socklen_t      type_len = sizeof(type);
+
+    luaL_argcheck(L, high > 0, 3, "high water mark must be positive");
+    luaL_argcheck(L, low >= 0 && low < high, 4,
+                  "low water mark must be in [0, high)");
+
+    flags = fcntl(fd, F_GETFL);
+    if ( flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0 ) {
+        return luaL_error(L, "unable to make fd %d non-blocking: %s",
+                          fd, strerror(errno));
+    }
+
+    writer = watcher_new(L, sizeof(evlua_writer), WRITER_MT, OBJ_WRITER);
+    ev_io_init(&writer->io, &writer_cb, fd, EV_WRITE);
+    ev_prepare_init(&writer->flush, &writer_prepare_cb);
+    writer->head   = 1;
+    writer->tail   = 1;
+    writer->offset = 0;
+    writer->queued = 0;
+    writer->high   = (size_t)high;
+    writer->low    = (size_t)low;
+    writer->corked = 0;
+    writer->above  = 0;
+    writer->is_socket = 0 == getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &type_len);
+#ifdef SO_NOSIGPIPE
+    if ( writer->is_socket ) {
+        type = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &type, sizeof(type));
+    }
+#endif
+
+    watcher_push_fenv(L, -1, 1);
+    lua_newtable(L);
+    lua_rawseti(L, -2, WATCHER_QUEUE);
+    lua_pop(L, 1);
+
+    return 1;
+}
+
+/**
+ * Writes as much of the queue (a table at queue_i) as the fd will
+ * take, WRITER_IOV strings per writev() call.  Sockets get sendmsg()
+ * instead, with MSG_NOSIGNAL so a closed peer is an EPIPE error rather
+ * than a SIGPIPE, and MSG_MORE while more of the queue follows.
+ * Returns 0 if the queue is empty or the fd would block, otherwise the
+ * errno of the failed call.
+ *
+ * [-0, +0, -]
+ */
+static int writer_flush(lua_State* L, evlua_writer* writer, int queue_i) {
+    struct iovec iov[WRITER_IOV];
+
+    queue_i = lua_absindex(L, queue_i);
+
+    while ( writer->head < writer->tail ) {
+        size_t  want = 0;
+        ssize_t got;
+        int     n    = 0;
+        int     full = 0;
+        int     i;
+
+        for ( i = writer->head; i < writer->tail && n < WRITER_IOV; i++, n++ ) {
+            size_t      len;
+            const char* str;
+
+            /* The string stays referenced by the queue, so str remains valid: */
+            lua_rawgeti(L, queue_i, i);
+            str = lua_tolstring(L, -1, &len);
+            lua_pop(L, 1);
+
+            if ( i == writer->head ) {
+                str += writer->offset;
+                len -= writer->offset;
+            }
+            iov[n].iov_base = (void*)str;
+            iov[n].iov_len  = len;
+            want += len;
+        }
+
+        if ( writer->is_socket ) {
+            struct msghdr msg;
+
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov    = iov;
+            msg.msg_iovlen = n;
+            /* More strings queued after these?  Then no partial segment yet: */
+            got = sendmsg(writer->io.fd, &msg,
+                          MSG_NOSIGNAL | ( i < writer->tail ? MSG_MORE : 0 ));
+        } else {
+            got = writev(writer->io.fd, iov, n);
+        }
+        if ( got < 0 ) {
+            if ( errno == EINTR ) continue;
+            if ( errno == EAGAIN || errno == EWOULDBLOCK ) return 0;
+            return errno;
+        }
+
+        writer->queued -= (size_t)got;
+        if ( (size_t)got < want ) full = 1;
+        for ( i = 0; i < n && (size_t)got >= iov[i].iov_len; i++ ) {
+            got -= iov[i].iov_len;
+            lua_pushnil(L);
+            lua_rawseti(L, queue_i, writer->head++);
+            writer->offset = 0;
+        }
+        writer->offset += (size_t)got;
+
+        /* A short write means the kernel buffer is full: */
+        if ( full ) break;
+    }
+
+    if ( writer->head == writer->tail ) {
+        /* Empty, so start over to keep the queue in the array part: */
+        writer->head   = 1;
+        writer->tail   = 1;
+        writer->offset = 0;
+    }
+    return 0;
+}
+
+/**
+ * Flushes the queue of a registered writer and takes care of the
+ * EV_WRITE interest.  The callback is invoked with "low" once the
+ * queue drains to the low water mark after it reached the high water
+ * mark, or with "error" and a message (after stopping the writer) if
+ * writev() failed.
+ *
+ * [+0, -0, m]
+ */
+static void writer_drain(struct ev_loop* loop, evlua_writer* writer) {
+    lua_State*     L   = ev_userdata(loop);
+    evlua_watcher* ext = WATCHER_EXT(writer);
+    int            err;
+
+    assert(LUA_NOREF != ext->ref /* only flushed while registered */);
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ext->ref);
+    watcher_push_fenv(L, -1, 1);
+    lua_rawgeti(L, -1, WATCHER_QUEUE);
+    err = writer_flush(L, writer, -1);
+    lua_pop(L, 3);
+
+    if ( err ) {
+        ev_io_stop(loop, &writer->io);
+        ev_prepare_stop(loop, &writer->flush);
+        lua_pushliteral(L, "error");
+        lua_pushstring(L, strerror(err));
+        watcher_cb_args(loop, writer, EV_WRITE, 2);
+        return;
+    }
+
+    if ( writer->above && writer->queued <= writer->low ) {
+        writer->above = 0;
+        /* watcher_cb() unregisters watchers that are not active: */
+        ev_io_start(loop, &writer->io);
+        lua_pushliteral(L, "low");
+        watcher_cb_args(loop, writer, EV_WRITE, 1);
+    } else if ( writer->queued ) {
+        ev_io_start(loop, &writer->io);
+    }
+
+    if ( 0 == writer->queued ) ev_io_stop(loop, &writer->io);
+}
+
+/**
+ * The fd is writable again.
+ *
+ * [+0, -0, m]
+ */
+static void writer_cb(struct ev_loop* loop, ev_io* io, int revents) {
+    writer_drain(loop, (evlua_writer*)io);
+}
+
+/**
+ * Flushes the writes a corked writer collected during this loop
+ * iteration.
+ *
+ * [+0, -0, m]
+ */
+static void writer_prepare_cb(struct ev_loop* loop, ev_prepare* prepare, int revents) {
+    evlua_writer* writer = (evlua_writer*)
+        ((char*)prepare - offsetof(evlua_writer, flush));
+
+    ev_prepare_stop(loop, prepare);
+    writer_drain(loop, writer);
+}
+
+/**
+ * Queues a string to be written.  Unless the writer is corked, as
+ * much as possible is written right away.  Returns false once the
+ * queue has reached the high water mark, in which case the callback
+ * is invoked with "low" when it is drained again.
+ *
+ * Usage:
+ *     bool = writer:write(data)
+ *
+ * [+1, -0, e]
+ */
+static int writer_write(lua_State *L) {
+    evlua_writer*   writer = check_writer(L, 1);
+    evlua_watcher*  ext    = WATCHER_EXT(writer);
+    size_t          len;
+    struct ev_loop* loop;
+
+    luaL_checklstring(L, 2, &len);
+    if ( NULL == ext->loop ) {
+        return luaL_error(L, "writer must be started before writing");
+    }
+    loop = ext->loop->loop;
+
+    if ( len ) {
+        watcher_push_fenv(L, 1, 1);
+        lua_rawgeti(L, -1, WATCHER_QUEUE);
+        lua_pushvalue(L, 2);
+        lua_rawseti(L, -2, writer->tail++);
+        writer->queued += len;
+
+        if ( writer->corked ) {
+            ev_prepare_start(loop, &writer->flush);
+        } else if ( ! ev_is_active(&writer->io) ) {
+            /* Errors are reported by writer_cb(), the fd polls as writable: */
+            if ( writer_flush(L, writer, -1) || writer->queued ) {
+                ev_io_start(loop, &writer->io);
+            }
+        }
+        lua_pop(L, 2);
+    }
+
+    if ( writer->queued >= writer->high ) writer->above = 1;
+
+    lua_pushboolean(L, ! writer->above);
+    return 1;
+}
+
+/**
+ * Returns true if writes are deferred to the end of the loop
+ * iteration and optionally turns that on or off.  Uncorking flushes
+ * on the next loop iteration.
+ *
+ * Usage:
+ *     old_corked = writer:cork([corked])
+ *
+ * [+1, -0, e]
+ */
+static int writer_cork(lua_State *L) {
+    evlua_writer* writer = check_writer(L, 1);
+    int           old    = writer->corked;
+
+    if ( ! lua_isnoneornil(L, 2) ) {
+        writer->corked = lua_toboolean(L, 2);
+    }
+
+    lua_pushboolean(L, old);
+    return 1;
+}
+
+/**
+ * Returns the number of bytes waiting to be written.
+ *
+ * Usage:
+ *     bytes = writer:queued()
+ *
+ * [+1, -0, e]
+ */
+static int writer_queued(lua_State *L) {
+    evlua_writer* writer = check_writer(L, 1);
+
+    lua_pushinteger(L, (lua_Integer)writer->queued);
+    return 1;
+}
+
+/**
+ * Stops the writer so it won't be flushed by the specified event
+ * loop.  Data still queued is kept and written once the writer is
+ * started again.
+ *
+ * Usage:
+ *     writer:stop(loop)
+ *
+ * [+0, -0, e]
+ */
+static int writer_stop(lua_State *L) {
+    evlua_writer*   writer = check_writer(L, 1);
+    struct ev_loop* loop   = *check_loop_and_init(L, 2);
+
+    loop_stop_watcher(L, 1);
+    ev_io_stop(loop, &writer->io);
+    ev_prepare_stop(loop, &writer->flush);
+
+    return 0;
+}
+
+/**
+ * Starts the writer so it will be flushed by the specified event
+ * loop.  A writer only keeps the loop running while it has data to
+ * write, so there is no is_daemon argument.
+ *
+ * Usage:
+ *     writer:start(loop)
+ *
+ * [+0, -0, e]
+ */
+static int writer_start(lua_State *L) {
+    evlua_writer*   writer = check_writer(L, 1);
+    struct ev_loop* loop   = *check_loop_and_init(L, 2);
+
+    loop_start_watcher(L, 2, 1, 0);
+    if ( writer->queued ) ev_prepare_start(loop, &writer->flush);
+
+    return 0;
+}
+
+/**
+ * Returns the file descriptor being written.
+ *
+ * Usage:
+ *     writer:getfd()
+ *
+ * [+1, -0, e]
+ */
+static int writer_getfd(lua_State *L) {
+    evlua_writer* writer = check_writer(L, 1);
+
+    lua_pushinteger(L, writer->io.fd);
+
+    return 1;
+}